@@ -196,11 +196,7 @@ void settings_bowden_length()
 					if (bowdenLength.decrease()) {
 						set_pulley_dir_pull();
 
-						for(auto i = bowdenLength.stepSize; i > 0; --i)
-						{
-						delayMicroseconds(1200);
-						do_pulley_step();
-						}
+						do_pulley_steps(bowdenLength.stepSize, 1200);
 					}
 				}
 				button_active = true;
@@ -210,11 +206,7 @@ void settings_bowden_length()
 					if(bowdenLength.increase()) {
 						set_pulley_dir_push();
 
-						for(auto i = bowdenLength.stepSize; i > 0; --i)
-						{
-							delayMicroseconds(1200);
-							do_pulley_step();
-						}
+						do_pulley_steps(bowdenLength.stepSize, 1200);
 					}
 				}
 				button_active = true;
@@ -0,0 +1,86 @@
+//! @file
+//! @brief Selector and idler acceleration ramps generated at compile time
+//!
+//! Constant acceleration from rate start, speed after k steps is
+//! sqrt(RATE_START^2 + 2 * ACCELERATION * k). The table of an axis holds the step
+//! periods from RATE_START up to RATE_MAX, its last entry is the cruise period.
+//! move() accelerates by incrementing the ramp index and decelerates by
+//! decrementing it, no floating point math is done while stepping.
+
+#ifndef AXIS_RAMP_H_
+#define AXIS_RAMP_H_
+
+#include <stdint.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+#include "config.h"
+#include "index_sequence.h"
+
+namespace axis_ramp
+{
+
+constexpr float rate_start(uint8_t axis)
+{
+    return (axis == AX_SEL) ? SELECTOR_RATE_START : IDLER_RATE_START;
+}
+
+constexpr float rate_max(uint8_t axis)
+{
+    return (axis == AX_SEL) ? SELECTOR_RATE_MAX : IDLER_RATE_MAX;
+}
+
+constexpr float acceleration(uint8_t axis)
+{
+    return (axis == AX_SEL) ? SELECTOR_ACCELERATION : IDLER_ACCELERATION;
+}
+
+//! @brief Ramp index of cruise speed
+constexpr uint16_t last(uint8_t axis)
+{
+    return (rate_max(axis) <= rate_start(axis)) ? 0
+        : static_cast<uint16_t>(ceil((rate_max(axis) * rate_max(axis) - rate_start(axis) * rate_start(axis)) / (2 * acceleration(axis))));
+}
+
+constexpr uint16_t cruise_period(uint8_t axis)
+{
+    return static_cast<uint16_t>(ceil(1000000.0f / ((rate_max(axis) > rate_start(axis)) ? rate_max(axis) : rate_start(axis))));
+}
+
+//! @brief Ramp step period [us]
+constexpr uint16_t period(uint8_t axis, uint16_t index)
+{
+    return (index >= last(axis)) ? cruise_period(axis)
+        : static_cast<uint16_t>(1000000.0f / sqrt(rate_start(axis) * rate_start(axis) + 2 * acceleration(axis) * index) + 0.5f);
+}
+
+template<uint8_t axis, typename S> struct Table;
+template<uint8_t axis, uint16_t... I> struct Table<axis, IndexSequence<I...> >
+{
+    static const uint16_t period[sizeof...(I)];
+};
+template<uint8_t axis, uint16_t... I> const uint16_t Table<axis, IndexSequence<I...> >::period[sizeof...(I)] PROGMEM = {axis_ramp::period(axis, I)...};
+
+typedef Table<AX_SEL, MakeIndexSequence<last(AX_SEL) + 1>::Type> Selector;
+typedef Table<AX_IDL, MakeIndexSequence<last(AX_IDL) + 1>::Type> Idler;
+
+} // namespace axis_ramp
+
+//! @brief Number of steps to accelerate an axis to cruise speed
+//! @param axis AX_SEL or AX_IDL
+constexpr uint16_t axis_ramp_steps(uint8_t axis)
+{
+    return axis_ramp::last(axis);
+}
+
+//! @brief Step period of an axis at ramp index
+//! @param axis AX_SEL or AX_IDL
+//! @param index 0 (RATE_START), values from axis_ramp_steps(axis) up give the cruise period
+//! @return step period [us]
+inline uint16_t axis_ramp_period(uint8_t axis, uint16_t index)
+{
+    if (index > axis_ramp::last(axis)) index = axis_ramp::last(axis);
+    return (axis == AX_SEL) ? pgm_read_word(&axis_ramp::Selector::period[index])
+        : pgm_read_word(&axis_ramp::Idler::period[index]);
+}
+
+#endif //AXIS_RAMP_H_
@@ -47,6 +47,7 @@
 //filament lengths
 #define FILAMENT_FINDA_EXIT_MM  10.0f   // add ~16 if using m6 selector instead of m10
 #define FILAMENT_RETRACT_MM     8.0f
+#define FILAMENT_SELECTOR_CLEAR_MM 6.0f // part of FILAMENT_RETRACT_MM pulled before selector may move
 #define FILAMENT_BOWDEN_MM      427.0f
 #define FILAMENT_EJECT_MM		120.0f
 
@@ -45,6 +45,10 @@
 
 //UART1
 #define UART1_BDR 115200
+//ring buffer sizes, power of 2 up to 256
+//receive buffer holds printer bursts sent during long blocking phases (homing, retries)
+#define UART1_RX_BUFFER_SIZE 128
+#define UART1_TX_BUFFER_SIZE 64
 
 //stdin & stdout uart0/1
 #define UART_STD 0
@@ -66,6 +70,14 @@
 #define TMC2130_TCOOLTHRS_0    450
 #define TMC2130_TCOOLTHRS_1    450
 #define TMC2130_TCOOLTHRS_2    450
+// TPOWERDOWN delay after standstill before current drops to holding current, range 0-255, unit 2^18 driver clocks (about 20 ms)
+#define TMC2130_TPOWERDOWN_0   0
+#define TMC2130_TPOWERDOWN_1   0
+#define TMC2130_TPOWERDOWN_2   0
+// IHOLDDELAY time per step of smooth current drop to holding current, range 0-15 (0 instant), unit 2^18 driver clocks
+#define TMC2130_IHOLDDELAY_0   15
+#define TMC2130_IHOLDDELAY_1   15
+#define TMC2130_IHOLDDELAY_2   15
 
 //0 - PULLEY
 //1 - SELECTOR
@@ -125,4 +137,25 @@
 
 #include "config-mmu.h"
 
+//selector and idler speeds (steps/s, steps/s^2), a profile may define its own
+#ifndef SELECTOR_RATE_START
+#define SELECTOR_RATE_START     868.0f   // 1152 us, also the homing rate
+#endif
+#ifndef SELECTOR_RATE_MAX
+#define SELECTOR_RATE_MAX       2000.0f
+#endif
+#ifndef SELECTOR_ACCELERATION
+#define SELECTOR_ACCELERATION   10000.0f
+#endif
+
+#ifndef IDLER_RATE_START
+#define IDLER_RATE_START        868.0f
+#endif
+#ifndef IDLER_RATE_MAX
+#define IDLER_RATE_MAX          1800.0f
+#endif
+#ifndef IDLER_ACCELERATION
+#define IDLER_ACCELERATION      9000.0f
+#endif
+
 #endif //CONFIG_H_
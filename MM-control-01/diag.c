@@ -80,14 +80,16 @@ int8_t cmd_diag_uart1(FILE* inout)
 int8_t cmd_diag_tmc(FILE* inout, uint8_t axis)
 {
 	fprintf_P(inout, PSTR("TMC2130, axis %d diag\n"), axis);
-	uint8_t check = tmc2130_check_axis(axis);
+	uint16_t time_us[TMC2130_CHECK_TIMES];
+	uint8_t check = tmc2130_check_axis(axis, time_us);
 	const char* _ok = PSTR("OK");
 	const char* _ng = PSTR("NG");
-	fprintf_P(inout, PSTR(" SPI: %S\n"), (check & TMC2130_CHECK_SPI)?_ok:_ng);
-	fprintf_P(inout, PSTR(" MOT: %S\n"), (check & TMC2130_CHECK_SPI)?_ok:_ng);
-	fprintf_P(inout, PSTR(" STP: %S\n"), (check & TMC2130_CHECK_STP)?_ok:_ng);
-	fprintf_P(inout, PSTR(" DIR: %S\n"), (check & TMC2130_CHECK_STP)?_ok:_ng);
-	fprintf_P(inout, PSTR(" ENA: %S\n"), (check & TMC2130_CHECK_STP)?_ok:_ng);
+	fprintf_P(inout, PSTR(" SPI: %S %u us\n"), (check & TMC2130_CHECK_SPI)?_ok:_ng, time_us[TMC2130_CHECK_TIME_SPI]);
+	fprintf_P(inout, PSTR(" STP: %S %u us\n"), (check & TMC2130_CHECK_STP)?_ok:_ng, time_us[TMC2130_CHECK_TIME_PINS]);
+	fprintf_P(inout, PSTR(" DIR: %S\n"), (check & TMC2130_CHECK_DIR)?_ok:_ng);
+	fprintf_P(inout, PSTR(" MSC: %S %u us\n"), (check & TMC2130_CHECK_MSC)?_ok:_ng, time_us[TMC2130_CHECK_TIME_LOAD]);
+	fprintf_P(inout, PSTR(" MOC: %S\n"), (check & TMC2130_CHECK_MOC)?_ok:_ng);
+	fprintf_P(inout, PSTR(" ENA: %S %u us\n"), (check & TMC2130_CHECK_ENA)?_ok:_ng, time_us[TMC2130_CHECK_TIME_ENA]);
 	return 0;
 }
 
@@ -0,0 +1,74 @@
+//! @file
+//! @brief Progress events pushed to the printer
+
+#include "event.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include "main.h"
+#include "config.h"
+#include "phase.h"
+#include "step_engine.h"
+
+namespace
+{
+
+//! @brief Where the outermost occurrence of a phase started
+struct PhaseStart
+{
+    uint32_t time;      //!< micros()
+    uint16_t steps[3];  //!< step_engine_steps()
+    uint8_t depth;      //!< nesting of the phase in itself
+    bool report;        //!< events were enabled when phase started
+};
+
+bool s_enabled = false;
+char s_text[40]; //!< event being sent
+PhaseStart s_start[static_cast<uint8_t>(Phase::Count)];
+
+} // unnamed namespace
+
+void event_enable(bool enable)
+{
+    s_enabled = enable;
+}
+
+void event_phase_begin(Phase phase)
+{
+    PhaseStart &start = s_start[static_cast<uint8_t>(phase)];
+    if (start.depth++) return;
+    start.report = s_enabled;
+    if (!start.report) return;
+    start.time = micros();
+    for (uint8_t axis = 0; axis < 3; ++axis) start.steps[axis] = step_engine_steps(axis);
+    snprintf_P(s_text, sizeof(s_text), PSTR("#B%d"), static_cast<uint8_t>(phase));
+    send_event(s_text);
+}
+
+//! Phase which started before events were enabled is not reported.
+void event_phase_end(Phase phase)
+{
+    PhaseStart &start = s_start[static_cast<uint8_t>(phase)];
+    if (!start.depth || --start.depth || !start.report || !s_enabled) return;
+    snprintf_P(s_text, sizeof(s_text), PSTR("#E%d %lu %u %u %u"), static_cast<uint8_t>(phase), micros() - start.time,
+        static_cast<uint16_t>(step_engine_steps(AX_PUL) - start.steps[AX_PUL]),
+        static_cast<uint16_t>(step_engine_steps(AX_SEL) - start.steps[AX_SEL]),
+        static_cast<uint16_t>(step_engine_steps(AX_IDL) - start.steps[AX_IDL]));
+    send_event(s_text);
+}
+
+//! @param finda FINDA state it changed to
+void event_finda(uint8_t finda)
+{
+    if (!s_enabled) return;
+    snprintf_P(s_text, sizeof(s_text), PSTR("#F%d"), finda);
+    send_event(s_text);
+}
+
+//! @param phase phase being repeated
+//! @param retry 1 for first repetition
+void event_retry(Phase phase, uint8_t retry)
+{
+    if (!s_enabled) return;
+    snprintf_P(s_text, sizeof(s_text), PSTR("#R%d %d"), static_cast<uint8_t>(phase), retry);
+    send_event(s_text);
+}
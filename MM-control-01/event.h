@@ -0,0 +1,32 @@
+//! @file
+//! @brief Progress events pushed to the printer
+//!
+//! Off by default, the printer enables them by N1 and disables them by N0.
+//! Each event is a line on uart_com starting with '#', sent as it happens
+//! (a frame in binary protocol, see send_event()):
+//!
+//! Event                    | Line
+//! ------------------------ | ----------------------------------------------------
+//! phase started            | #B\<phase\>
+//! phase finished           | #E\<phase\> \<elapsed us\> \<pulley\> \<selector\> \<idler steps\>
+//! FINDA changed            | #F\<0 or 1\>
+//! phase retried            | #R\<phase\> \<retry\>
+//!
+//! \<phase\> is the number of Phase: 0 unload_to_finda, 1 retract_filament,
+//! 2 motion_set_idler_selector, 3 load_filament_withSensor, 4 motion_feed_to_bondtech,
+//! 5 home_idler, 6 home_selector. Only the outermost occurrence of a nested phase is reported.
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdint.h>
+
+enum class Phase : uint8_t;
+
+void event_enable(bool enable);
+void event_phase_begin(Phase phase);
+void event_phase_end(Phase phase);
+void event_finda(uint8_t finda);
+void event_retry(Phase phase, uint8_t retry);
+
+#endif //EVENT_H_
@@ -0,0 +1,23 @@
+//! @file
+//! @brief Compile time index sequence 0 ... N-1 for generated PROGMEM tables
+//!
+//! Template recursion depth is log2(N), so tables of several hundred entries
+//! do not hit the compiler instantiation depth limit.
+
+#ifndef INDEX_SEQUENCE_H_
+#define INDEX_SEQUENCE_H_
+
+#include <stdint.h>
+
+template<uint16_t... I> struct IndexSequence
+{
+    typedef IndexSequence<I..., (I + sizeof...(I))...> Double;
+    typedef IndexSequence<I..., (I + sizeof...(I))..., 2 * sizeof...(I)> DoublePlusOne;
+};
+
+template<uint16_t N, bool odd = N & 1> struct MakeIndexSequence;
+template<uint16_t N> struct MakeIndexSequence<N, false> { typedef typename MakeIndexSequence<N / 2>::Type::Double Type; };
+template<uint16_t N> struct MakeIndexSequence<N, true> { typedef typename MakeIndexSequence<N / 2>::Type::DoublePlusOne Type; };
+template<> struct MakeIndexSequence<0, false> { typedef IndexSequence<> Type; };
+
+#endif //INDEX_SEQUENCE_H_
@@ -14,6 +14,7 @@
 #include "abtn3.h"
 #include "mmctl.h"
 #include "stepper.h"
+#include "step_engine.h"
 #include "Buttons.h"
 #include <avr/wdt.h>
 #include "permanent_storage.h"
@@ -21,6 +22,9 @@
 #include "config.h"
 #include "motion.h"
 #include "display.h"
+#include "event.h"
+#include "trace.h"
+#include "telemetry.h"
 
 
 uint8_t tmc2130_mode = NORMAL_MODE;
@@ -72,7 +76,75 @@ enum class S
 //! @enduml
 static S state;
 
-static void process_commands(FILE* inout);
+//! @brief Reply of command handler
+enum class Reply : uint8_t
+{
+    Rejected,   //!< invalid command, binary protocol replies it, text protocol does not
+    None,       //!< no reply
+    Ok,         //!< "ok"
+    Value,      //!< "<value>ok"
+};
+
+const uint8_t frame_rejected = 0x80;    //!< reply opcode flag of rejected command
+const uint8_t frame_accepted = 0x20;    //!< opcode flag of acceptance, lower case command letter
+
+//! @brief Command parser state of a stream
+//!
+//! Each stream assembles its own line, so commands arriving at the same time
+//! on USB and on printer link do not corrupt each other.
+struct CommandContext
+{
+    FILE* stream;   //!< read commands from and reply to, nullptr if not used
+    bool echo;      //!< copy received bytes to USB console trace, see trace.h
+    bool overflow;  //!< line too long, discarded up to its end
+    bool hold;      //!< not read until its queued B command ran
+    bool binary;    //!< binary protocol, see process_frame()
+    uint8_t count;  //!< bytes received in line
+    char line[32];  //!< text line or binary frame
+    //! @name Last reply in binary protocol, sent again for repeated request
+    //! @{
+    uint8_t last_seq;
+    char last_op;
+    Reply last_reply;
+    int16_t last_result;
+    //! @}
+};
+
+//! @brief Where reply of a command goes
+struct ReplyTo
+{
+    CommandContext* context;
+    uint8_t seq;    //!< binary protocol sequence number
+    char op;        //!< command letter
+};
+
+//! @brief Command accepted for execution
+struct QueuedCommand
+{
+    CommandContext* context;
+    char cmd;
+    uint8_t seq;
+    int16_t value;
+    int16_t value0;
+};
+
+static CommandContext s_com_context; //!< printer link, uart_com
+static CommandContext s_std_context; //!< USB console, stdin, for testing and debugging
+
+const uint8_t command_queue_size = 4; //!< power of 2, one slot stays free
+static QueuedCommand s_command_queue[command_queue_size]; //!< commands of both streams in order of arrival
+static uint8_t s_queue_head = 0; //!< next to run
+static uint8_t s_queue_tail = 0; //!< next free
+
+#if (UART_COM == 0)
+static bool s_filament_sensed = false; //!< printer sent 'A', recognized by process_commands()
+#endif
+static ReplyTo s_command = {&s_com_context, 0, 0}; //!< command being executed
+static ReplyTo s_wait_reply = {&s_com_context, 0, 'W'}; //!< W0 waiting for user
+
+static void process_commands(CommandContext &context, bool background = false);
+static void run_queued_command();
+static void send_wait_reply();
 
 static void led_blink(int _no)
 {
@@ -233,8 +305,30 @@ void unrecoverable_error()
     }
 }
 
+//! @brief Run driver self-test, see tmc2130_check_axis()
+//!
+//! Result flags and duration of each check are printed on USB console if any check
+//! failed or report is set.
+//! @param axis axis
+//! @param report print passed test too
+//! @return TMC2130_CHECK_* flags of passed checks
+static uint8_t check_driver(uint8_t axis, bool report)
+{
+    uint16_t time_us[TMC2130_CHECK_TIMES];
+    const uint8_t check = tmc2130_check_axis(axis, time_us);
+    if (report || (check != TMC2130_CHECK_OK))
+    {
+        fprintf_P(uart0io, PSTR("TMC2130 axis %d check 0x%02x, SPI %u us, STP DIR %u us, MSC MOC %u us, ENA %u us\n"),
+            axis, check, time_us[TMC2130_CHECK_TIME_SPI], time_us[TMC2130_CHECK_TIME_PINS],
+            time_us[TMC2130_CHECK_TIME_LOAD], time_us[TMC2130_CHECK_TIME_ENA]);
+    }
+    return check;
+}
+
 //! @brief Initialization after reset
 //!
+//! Failing drivers are reported on USB console, see check_driver().
+//!
 //! button | action
 //! ------ | ------
 //! middle | enter setup
@@ -262,6 +356,7 @@ void setup()
 #endif
     permanentStorageInit();
     shr16_init(); // shift register
+    step_engine_init();
     led_blink(0);
     
     uart0_init(); //uart0
@@ -275,6 +370,9 @@ void setup()
     stdin = uart1io; // stdin = uart1
     stdout = uart1io; // stdout = uart1
 #endif //(UART_STD == 1)
+    s_com_context.stream = uart_com;
+    s_com_context.echo = (uart_com != uart0io);
+    if (stdin != uart_com) s_std_context.stream = stdin;
     
     fprintf_P(uart_com, PSTR("start\n")); //startup message
     
@@ -300,7 +398,8 @@ void setup()
     }
 
     tmc2130_init(HOMING_MODE);
-    tmc2130_read_gstat(); //consume reset after power up
+    set_boot_drive_reset(tmc2130_read_gstat()); //consume reset after power up, position is lost
+    for (uint8_t axis = AX_PUL; axis <= AX_IDL; ++axis) check_driver(axis, false);
     uint8_t filament;
     if(FilamentLoaded::get(filament)  &&  (digitalRead(A1) == 1))
     {
@@ -386,8 +485,12 @@ void manual_extruder_selector()
 //! @copydoc manual_extruder_selector()
 void loop()
 {
-    process_commands(uart_com);
-    process_commands(stdin);    // for testing and debugging
+    process_commands(s_com_context);
+    process_commands(s_std_context);
+    run_queued_command();
+    trace_flush();
+    telemetry_poll();
+    motion_persist_position();
 
     switch (state)
     {
@@ -417,7 +520,7 @@ void loop()
         display_error(MSG_WAITING);
         enhanced_interactive_menu();
         state = S::Idle;
-        fprintf_P(uart_com, PSTR("ok\n"));
+        send_wait_reply();
         display_message(MSG_IDLE);
 #else
         signal_load_failure(800);
@@ -428,7 +531,7 @@ void loop()
             break;
         case Btn::right:
             state = S::Idle;
-            fprintf_P(uart_com, PSTR("ok\n"));
+            send_wait_reply();
             break;
         default:
             break;
@@ -444,7 +547,7 @@ void loop()
             break;
         case Btn::right:
             state = S::Idle;
-            fprintf_P(uart_com, PSTR("ok\n"));
+            send_wait_reply();
             break;
         default:
             break;
@@ -453,168 +556,628 @@ void loop()
     }
 }
 
-//! @brief receive and process commands from serial line
-//! @param[in,out] inout struct connected to serial line to be used
-//!
-//! All commands have syntax in form of one letter integer number.
-void process_commands(FILE* inout)
+//! T<nr.> change to filament <nr.>
+static Reply cmd_change_tool(int value, int, int16_t &)
+{
+	if ((value >= 0) && (value < EXTRUDERS))
+	{
+		state = S::Printing;
+		switch_extruder_withSensor(value);
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+//! L<nr.> Load filament <nr.>
+static Reply cmd_load(int value, int, int16_t &)
 {
-	static char line[32];
-	static int count = 0;
-	int c = -1;
-	if (count < 32)
+	if ((value >= 0) && (value < EXTRUDERS))
 	{
-		if ((c = getc(inout)) >= 0)
+		if (isFilamentLoaded) state = S::SignalFilament;
+		else
 		{
-			Serial.write(c); // debug printer input back to console
-			if (c == '\r') c = 0;
-			if (c == '\n') c = 0;
-			line[count++] = c;
+			select_extruder(value);
+			feed_filament();
 		}
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_mode(int value, int, int16_t &)
+{
+	//! M0 set to normal mode
+	//!@n M1 set to stealth mode
+	switch (value) {
+		case 0: tmc2130_mode = NORMAL_MODE; break;
+		case 1: tmc2130_mode = STEALTH_MODE; break;
+		default: return Reply::Rejected;
+	}
+
+	//init all axes
+	tmc2130_init(tmc2130_mode);
+	return Reply::Ok;
+}
+
+//! U<nr.> Unload filament. <nr.> is ignored but mandatory.
+static Reply cmd_unload(int, int, int16_t &)
+{
+	unload_filament_withSensor(true);
+	state = S::Idle;
+	return Reply::Ok;
+}
+
+static Reply cmd_reset(int value, int, int16_t &)
+{
+	if (value == 0) //! X0 MMU reset
+	{
+		wdt_enable(WDTO_15MS);
+		return Reply::None;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_finda(int value, int, int16_t &result)
+{
+	if (value == 0) //! P0 Read finda
+	{
+		result = digitalRead(A1);
+		return Reply::Value;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_status(int value, int, int16_t &result)
+{
+	if (value == 0) //! S0 return ok
+		return Reply::Ok;
+	else if (value == 1) //! S1 Read version
+		result = fw_version;
+	else if (value == 2) //! S2 Read build nr.
+		result = fw_buildnr;
+	else if (value == 3) //! S3 Read drive errors
+		result = DriveError::get();
+	else if (value == 4) //! S4 Read idler homing result 0 not homed, 1 failed, 2 ambiguous, 3 confident
+		result = static_cast<uint8_t>(get_homing_result(AX_IDL));
+	else if (value == 5) //! S5 Read selector homing result
+		result = static_cast<uint8_t>(get_homing_result(AX_SEL));
+	else if (value == 6) //! S6 Read bytes dropped by USB console trace, saturates at 32767
+		result = min(trace_dropped(), static_cast<uint16_t>(INT16_MAX));
+	else if (value == 7) //! S7 Read bytes lost by UART1, receive buffer full or data overrun, saturates at 32767
+		result = min(uart1_error_count(UART1_ERR_OVERFLOW), static_cast<uint16_t>(INT16_MAX));
+	else if (value == 8) //! S8 Read UART1 framing errors
+		result = min(uart1_error_count(UART1_ERR_FRAME), static_cast<uint16_t>(INT16_MAX));
+	else if (value == 9) //! S9 Read UART1 parity errors
+		result = min(uart1_error_count(UART1_ERR_PARITY), static_cast<uint16_t>(INT16_MAX));
+	else if (value == 10) //! S10 Read TMC2130 register writes sent, saturates at 32767, see tmc2130_tx()
+		result = min(tmc2130_get_writes_sent(), static_cast<uint16_t>(INT16_MAX));
+	else if (value == 11) //! S11 Read TMC2130 register writes skipped as the register holds the value
+		result = min(tmc2130_get_writes_skipped(), static_cast<uint16_t>(INT16_MAX));
+	else return Reply::Rejected;
+	return Reply::Value;
+}
+
+//! F<nr.> \<type\> filament type. <nr.> filament number, \<type\> 0, 1 or 2. Does nothing.
+static Reply cmd_filament_type(int value, int value0, int16_t &)
+{
+	if (((value >= 0) && (value < EXTRUDERS)) &&
+		((value0 >= 0) && (value0 <= 2)))
+	{
+		filament_type[value] = value0;
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_continue_load(int value, int, int16_t &)
+{
+	if (value == 0) //! C0 continue loading current filament (used after T-code).
+	{
+		load_filament_inPrinter();
+		return Reply::Ok;
 	}
-	else
+	return Reply::Rejected;
+}
+
+static Reply cmd_eject(int value, int, int16_t &)
+{
+	if ((value >= 0) && (value < EXTRUDERS)) //! E<nr.> eject filament
 	{
-		count = 0;
-		//overflow
+		eject_filament(value);
+		state = S::Printing;
+		return Reply::Ok;
 	}
-	char cmd;
+	return Reply::Rejected;
+}
+
+static Reply cmd_recover(int value, int, int16_t &)
+{
+	if (value == 0) //! R0 recover after eject filament
+	{
+		recover_after_eject();
+		state = S::Idle;
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_wait(int value, int, int16_t &)
+{
+	if (value == 0) //! W0 Wait for user click, "ok" is sent when user is done
+	{
+		state = S::Wait;
+		s_wait_reply = s_command;
+		return Reply::None;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_cut(int value, int, int16_t &)
+{
+	if ((value >= 0) && (value < EXTRUDERS)) //! K<nr.> cut filament
+	{
+#ifdef ENABLE_CUTTER
+		mmctl_cut_filament(value);
+#endif
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_events(int value, int, int16_t &)
+{
+	if ((value == 0) || (value == 1)) //! N0 disable, N1 enable progress events on printer link, see event.h
+	{
+		event_enable(value);
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_trace(int value, int, int16_t &)
+{
+	if ((value == 0) || (value == 1)) //! D0 disable, D1 enable trace of printer input on USB console, see trace.h
+	{
+		trace_enable(value);
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_telemetry(int value, int value0, int16_t &)
+{
+	//! Q0 stop, Q<period ms> stream CSV, Q<period ms> 1 stream binary telemetry samples on USB console, see telemetry.h
+	if ((value >= 0) && ((value0 == 0) || (value0 == 1)))
+	{
+		telemetry_start(value, value0);
+		return Reply::Ok;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_check(int value, int, int16_t &result)
+{
+	//! V<axis> driver self-test, replies TMC2130_CHECK_* flags of passed checks (63 all passed),
+	//!@n check durations are printed on USB console, see tmc2130_check_axis()
+	if ((value >= AX_PUL) && (value <= AX_IDL))
+	{
+		result = check_driver(value, true);
+		return Reply::Value;
+	}
+	return Reply::Rejected;
+}
+
+static Reply cmd_protocol(int value, int, int16_t &)
+{
+	//! B0 text protocol
+	//!@n B1 binary protocol on this stream, switched after the reply, see process_frame()
+	if ((value == 0) || (value == 1)) return Reply::Ok;
+	return Reply::Rejected;
+}
+
+//! @brief Command handler
+//! @param value number following command letter
+//! @param value0 second number, 0 if not present
+//! @param [out] result replied value if Reply::Value is returned
+typedef Reply (*CommandHandler)(int value, int value0, int16_t &result);
+
+//! @brief Command handlers indexed by command letter - 'A', nullptr for unknown commands
+//!
+//! Commands received from serial line have syntax in form of one letter integer
+//! number, optionally followed by second number, e.g. T1 or F1 2. Lines end with
+//! LF or CR. B1 switches the stream to the binary protocol, see process_frame().
+static const CommandHandler command_handlers[] PROGMEM =
+{
+	nullptr,            // A
+	cmd_protocol,       // B
+	cmd_continue_load,  // C
+	cmd_trace,          // D
+	cmd_eject,          // E
+	cmd_filament_type,  // F
+	nullptr,            // G
+	nullptr,            // H
+	nullptr,            // I
+	nullptr,            // J
+	cmd_cut,            // K
+	cmd_load,           // L
+	cmd_mode,           // M
+	cmd_events,         // N
+	nullptr,            // O
+	cmd_finda,          // P
+	cmd_telemetry,      // Q
+	cmd_recover,        // R
+	cmd_status,         // S
+	cmd_change_tool,    // T
+	cmd_unload,         // U
+	cmd_check,          // V
+	cmd_wait,           // W
+	cmd_reset,          // X
+	nullptr,            // Y
+	nullptr,            // Z
+};
+
+//! @brief CRC-8, polynomial 0x07
+static uint8_t crc8(uint8_t crc, uint8_t data)
+{
+	crc ^= data;
+	for (uint8_t i = 0; i < 8; ++i)
+	{
+		crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+	}
+	return crc;
+}
+
+//! @brief Send binary protocol frame
+void send_frame(FILE* stream, uint8_t seq, uint8_t op, const uint8_t* payload, uint8_t length)
+{
+	uint8_t crc = crc8(crc8(crc8(0, length), seq), op);
+	putc(frame_start, stream);
+	putc(length, stream);
+	putc(seq, stream);
+	putc(op, stream);
+	for (uint8_t i = 0; i < length; ++i)
+	{
+		putc(payload[i], stream);
+		crc = crc8(crc, payload[i]);
+	}
+	putc(crc, stream);
+}
+
+//! @brief Send reply of a command in protocol of the stream it came from
+//!
+//! Text protocol sends "ok" or "<result>ok", rejected command is not replied.
+//! Binary protocol replies every command, see process_frame().
+static void send_reply(const ReplyTo &to, Reply reply, int16_t result)
+{
+	CommandContext &context = *to.context;
+	if (context.binary)
+	{
+		context.last_seq = to.seq;
+		context.last_op = to.op;
+		context.last_reply = reply;
+		context.last_result = result;
+		if (reply == Reply::None) return;
+		const uint8_t payload[2] = {static_cast<uint8_t>(result), static_cast<uint8_t>(result >> 8)};
+		const uint8_t op = (reply == Reply::Rejected) ? (to.op | frame_rejected) : to.op;
+		send_frame(context.stream, to.seq, op, payload, (reply == Reply::Value) ? 2 : 0);
+	}
+	else if (reply == Reply::Ok) fprintf_P(context.stream, PSTR("ok\n"));
+	else if (reply == Reply::Value) fprintf_P(context.stream, PSTR("%dok\n"), result);
+}
+
+//! @brief Reply "ok" to W0 once user is done
+static void send_wait_reply()
+{
+	send_reply(s_wait_reply, Reply::Ok, 0);
+}
+
+//! @brief Send progress event line to the printer
+//! @param text event starting with '#', without line end
+void send_event(const char* text)
+{
+	if (s_com_context.binary)
+	{
+		send_frame(uart_com, 0, '#', reinterpret_cast<const uint8_t*>(text + 1), strlen(text + 1));
+	}
+	else fprintf_P(uart_com, PSTR("%s\n"), text);
+}
+
+//! @brief Parse decimal integer in place
+//!
+//! Accepts the same input as %d conversion of sscanf: leading white space and sign.
+//! @param [in,out] text advanced past the number on success
+//! @param [out] value
+//! @retval true number parsed
+//! @retval false no digit found, text and value untouched
+static bool parse_int(const char* &text, int &value)
+{
+	const char* c = text;
+	while (*c == ' ' || *c == '\t') ++c;
+	const bool negative = (*c == '-');
+	if (*c == '-' || *c == '+') ++c;
+	if (*c < '0' || *c > '9') return false;
+	int number = 0;
+	do
+	{
+		number = number * 10 + (*c++ - '0');
+	} while (*c >= '0' && *c <= '9');
+	value = negative ? -number : number;
+	text = c;
+	return true;
+}
+
+//! @brief Command only reads state and replies at once
+//!
+//! Query commands are answered even while a long running command is in progress.
+static bool is_query(char cmd)
+{
+	return (cmd == 'P') || (cmd == 'S');
+}
+
+//! @brief Read and clear printer 'A' signal
+static bool take_filament_sensed()
+{
+#if (UART_COM == 0)
+	const bool sensed = s_filament_sensed;
+	s_filament_sensed = false;
+	return sensed;
+#else
+	return uart1_take_filament_sensed();
+#endif
+}
+
+//! @brief Run command handler and send its reply
+//! @param context stream the command came from
+//! @param cmd command letter
+//! @param value number following command letter
+//! @param value0 second number, 0 if not present
+//! @param seq binary protocol sequence number
+static void process_command(CommandContext &context, char cmd, int value, int value0, uint8_t seq)
+{
+	const ReplyTo caller = s_command;
+	s_command.context = &context;
+	s_command.seq = seq;
+	s_command.op = cmd;
+
+	const uint8_t index = cmd - 'A';
+	CommandHandler handler = nullptr;
+	if (index < sizeof(command_handlers) / sizeof(command_handlers[0]))
+	{
+		handler = reinterpret_cast<CommandHandler>(pgm_read_ptr(&command_handlers[index]));
+	}
+	int16_t result = 0;
+	Reply reply = Reply::Rejected;
+	if (handler)
+	{
+		if (!is_query(cmd)) take_filament_sensed(); //'A' sent before the command is stale
+		reply = handler(value, value0, result);
+	}
+	send_reply(s_command, reply, result);
+	if ((cmd == 'B') && (reply == Reply::Ok))
+	{
+		context.binary = value;
+		context.last_op = 0;
+	}
+
+	s_command = caller;
+}
+
+static uint8_t queue_next(uint8_t index)
+{
+	return (index + 1) & (command_queue_size - 1);
+}
+
+static bool queue_full()
+{
+	return queue_next(s_queue_tail) == s_queue_head;
+}
+
+//! @brief Run query command at once, queue any other command
+//!
+//! Queued commands of both streams run one by one from loop() in order of arrival,
+//! so the printer can send e.g. F, T and C0 without waiting for each "ok".
+//! In binary protocol acceptance is confirmed by a frame with the request sequence
+//! and lower case command letter as opcode, the reply follows once the command ran.
+//! Repeated request still in queue is confirmed again, not queued twice.
+//! Stream which sent B is not read until B ran, as it changes protocol of the stream.
+static void accept_command(CommandContext &context, char cmd, int value, int value0, uint8_t seq)
+{
+	if (is_query(cmd))
+	{
+		process_command(context, cmd, value, value0, seq);
+		return;
+	}
+	bool repeated = false;
+	for (uint8_t i = s_queue_head; i != s_queue_tail; i = queue_next(i))
+	{
+		const QueuedCommand &queued = s_command_queue[i];
+		if (context.binary && (queued.context == &context) && (queued.seq == seq) && (queued.cmd == cmd)) repeated = true;
+	}
+	if (!repeated)
+	{
+		QueuedCommand &queued = s_command_queue[s_queue_tail];
+		queued.context = &context;
+		queued.cmd = cmd;
+		queued.seq = seq;
+		queued.value = value;
+		queued.value0 = value0;
+		s_queue_tail = queue_next(s_queue_tail);
+		if (cmd == 'B') context.hold = true;
+	}
+	if (context.binary) send_frame(context.stream, seq, cmd | frame_accepted, nullptr, 0);
+}
+
+//! @brief Run oldest queued command
+static void run_queued_command()
+{
+	if (s_queue_head == s_queue_tail) return;
+	const QueuedCommand command = s_command_queue[s_queue_head];
+	s_queue_head = queue_next(s_queue_head);
+	process_command(*command.context, command.cmd, command.value, command.value0, command.seq);
+	if (command.cmd == 'B') command.context->hold = false;
+}
+
+//! @brief Parse command line and accept it
+//!
+//! Line is command letter followed by a number and an optional second number.
+//! Lines without number are ignored.
+//! @param context stream the line came from
+//! @param background long running command is in progress, do not update display
+static void process_line(CommandContext &context, bool background)
+{
+	const char* line = context.line;
+	const char cmd = line[0];
+	const char* arg = line + 1;
 	int value = 0;
 	int value0 = 0;
+	if (cmd == 0) return;
+	const bool has_value = parse_int(arg, value);
+#ifdef SSD_DISPLAY
+	if (!background) display_command(cmd, value, false);
+#else
+	(void)background;
+#endif
+	if (!has_value) return;
+	parse_int(arg, value0);
+	accept_command(context, cmd, value, value0, 0);
+}
 
-	if ((count > 0) && (c == 0))
+//! @brief Check and accept command received in binary protocol frame
+//!
+//! Frame is | 0xA5 | length | sequence | opcode | payload | CRC-8 of length to payload |.
+//!
+//! Request opcode is the command letter, payload of 0, 2 or 4 bytes is value and value0
+//! as little endian int16, missing numbers are 0. Reply has the sequence and opcode of the
+//! request and 2 byte payload of the value in place of "<value>ok", none for "ok". Commands
+//! other than queries are confirmed when accepted, see accept_command(). Rejected
+//! command is replied with opcode | 0x80, frame with wrong CRC with opcode 0.
+//! Repeated request, same sequence and opcode as the last one, is not executed again,
+//! its reply is sent again. Progress events are sent with sequence 0, opcode '#' and the event
+//! text following '#' as payload. B0 switches back to the text protocol after its reply.
+//! @param context stream the frame came from, line holds the frame
+//! @param background long running command is in progress, do not update display
+static void process_frame(CommandContext &context, bool background)
+{
+	const uint8_t* frame = reinterpret_cast<const uint8_t*>(context.line);
+	const uint8_t length = frame[1];
+	const uint8_t seq = frame[2];
+	const char cmd = frame[3];
+	uint8_t crc = 0;
+	for (uint8_t i = 1; i < length + 4; ++i) crc = crc8(crc, frame[i]);
+	if (crc != frame[length + 4])
+	{
+		send_frame(context.stream, seq, 0, nullptr, 0);
+		return;
+	}
+	if ((seq == context.last_seq) && (cmd == context.last_op))
 	{
-		//line received
-		//printf_P(PSTR("line received: '%s' %d\n"), line, count);
+		const ReplyTo to = {&context, seq, cmd};
+		send_reply(to, context.last_reply, context.last_result);
+		return;
+	}
+	const int value = (length >= 2) ? static_cast<int16_t>(frame[4] | (frame[5] << 8)) : 0;
+	const int value0 = (length >= 4) ? static_cast<int16_t>(frame[6] | (frame[7] << 8)) : 0;
 #ifdef SSD_DISPLAY
-		if (sscanf_P(line, PSTR("%c%d"), &cmd, &value) > 0) {
-			display_command(cmd, value, false);
+	if (!background) display_command(cmd, value, false);
+#else
+	(void)background;
+#endif
+	accept_command(context, cmd, value, value0, seq);
+}
+
+//! @brief Receive and process command
+//!
+//! Reads all bytes available in context stream, until a line or frame is complete.
+//! It is processed and remaining bytes are left for next call. Line longer than
+//! context buffer is dropped as a whole, frame with invalid length is dropped
+//! and the next frame start byte searched.
+//!
+//! Query commands are run at once, others are queued, see accept_command(). While
+//! the queue is full, stream is not read.
+//! Printer 'A' is taken out by the UART1 receive interrupt, see uart1_rx_token(),
+//! or here at line or frame start if the printer is connected to USB.
+//! @param context parser state of the stream
+//! @param background long running command is in progress
+void process_commands(CommandContext &context, bool background)
+{
+	if (!context.stream || context.hold || queue_full()) return;
+	int c;
+	while ((c = getc(context.stream)) >= 0)
+	{
+		if (context.echo && !context.binary) trace_byte(c); // debug printer input back to console
+#if (UART_COM == 0)
+		if (c == 'A' && context.count == 0 && context.stream == uart_com)
+		{
+			s_filament_sensed = true;
+			continue;
 		}
 #endif
-		
-		count = 0;
-        //! T<nr.> change to filament <nr.>
-		if (sscanf_P(line, PSTR("T%d"), &value) > 0)
+		if (context.binary)
 		{
-			if ((value >= 0) && (value < EXTRUDERS))
-			{
-			    state = S::Printing;
-				switch_extruder_withSensor(value);
-				fprintf_P(inout, PSTR("ok\n"));
-			}
+			if ((context.count == 0) && (c != frame_start)) continue;
+			context.line[context.count++] = c;
+			if ((context.count == 2) && (c > frame_payload_max)) context.count = 0;
+			if ((context.count < 5) || (context.count < 5 + static_cast<uint8_t>(context.line[1]))) continue;
 		}
-        //! L<nr.> Load filament <nr.>
-		else if (sscanf_P(line, PSTR("L%d"), &value) > 0)
+		else
 		{
-			if ((value >= 0) && (value < EXTRUDERS))
+			if (c == '\r') c = 0;
+			if (c == '\n') c = 0;
+			if (c == 0 && context.overflow)
 			{
-			    if (isFilamentLoaded) state = S::SignalFilament;
-			    else
-			    {
-                    select_extruder(value);
-                    feed_filament();
-			    }
-                fprintf_P(inout, PSTR("ok\n"));
+				context.overflow = false;
+				context.count = 0;
+				continue;
 			}
+			if (context.overflow) continue;
+			context.line[context.count++] = c;
+			if (context.count >= sizeof(context.line)) context.overflow = true;
+			if (c != 0) continue;
+			//line received
+			//printf_P(PSTR("line received: '%s' %d\n"), context.line, context.count);
 		}
-		else if (sscanf_P(line, PSTR("M%d"), &value) > 0)
-		{
-			//! M0 set to normal mode
-			//!@n M1 set to stealth mode
-			switch (value) {
-				case 0: tmc2130_mode = NORMAL_MODE; break;
-				case 1: tmc2130_mode = STEALTH_MODE; break;
-				default: return;
-			}
+		context.count = 0;
+		context.overflow = false;
+		if (context.binary) process_frame(context, background);
+		else process_line(context, background);
+		return;
+	}
+}
 
-			//init all axes
-			tmc2130_init(tmc2130_mode);
-			fprintf_P(inout, PSTR("ok\n"));
-		}
-		//! U<nr.> Unload filament. <nr.> is ignored but mandatory.
-		else if (sscanf_P(line, PSTR("U%d"), &value) > 0)
-		{
+//! @brief Receive commands while a long running command is in progress
+//!
+//! Query commands get their reply at once, see process_commands().
+static void process_commands_background()
+{
+	static bool busy = false;
+	if (busy) return;
+	busy = true;
+	process_commands(s_com_context, true);
+	process_commands(s_std_context, true);
+	busy = false;
+}
 
-			unload_filament_withSensor(true);
-			fprintf_P(inout, PSTR("ok\n"));
+//! @brief Called by delay() and step engine while waiting
+//!
+//! Long running commands (T, L, U, E, R, C, K) run from loop() and spend their
+//! time waiting for motion, meanwhile query commands are served and other
+//! commands are queued here. USB console trace and telemetry are sent as USB accepts them.
+void yield()
+{
+	process_commands_background();
+	trace_flush();
+	telemetry_poll();
+}
 
-			state = S::Idle;
-		}
-		else if (sscanf_P(line, PSTR("X%d"), &value) > 0)
-		{
-			if (value == 0) //! X0 MMU reset
-				wdt_enable(WDTO_15MS);
-		}
-		else if (sscanf_P(line, PSTR("P%d"), &value) > 0)
-		{
-			if (value == 0) //! P0 Read finda
-				fprintf_P(inout, PSTR("%dok\n"), digitalRead(A1));
-		}
-		else if (sscanf_P(line, PSTR("S%d"), &value) > 0)
-		{
-			if (value == 0) //! S0 return ok
-				fprintf_P(inout, PSTR("ok\n"));
-			else if (value == 1) //! S1 Read version
-				fprintf_P(inout, PSTR("%dok\n"), fw_version);
-			else if (value == 2) //! S2 Read build nr.
-				fprintf_P(inout, PSTR("%dok\n"), fw_buildnr);
-			else if (value == 3) //! S3 Read drive errors
-			    fprintf_P(inout, PSTR("%dok\n"), DriveError::get());
-		}
-		//! F<nr.> \<type\> filament type. <nr.> filament number, \<type\> 0, 1 or 2. Does nothing.
-		else if (sscanf_P(line, PSTR("F%d %d"), &value, &value0) > 0)
-		{
-			if (((value >= 0) && (value < EXTRUDERS)) &&
-				((value0 >= 0) && (value0 <= 2)))
-			{
-				filament_type[value] = value0;
-				fprintf_P(inout, PSTR("ok\n"));
-			}
-		}
-		else if (sscanf_P(line, PSTR("C%d"), &value) > 0)
-		{
-			if (value == 0) //! C0 continue loading current filament (used after T-code).
-			{
-				load_filament_inPrinter();
-				fprintf_P(inout, PSTR("ok\n"));
-			}
-		}
-		else if (sscanf_P(line, PSTR("E%d"), &value) > 0)
-		{
-			if ((value >= 0) && (value < EXTRUDERS)) //! E<nr.> eject filament
-			{
-				eject_filament(value);
-				fprintf_P(inout, PSTR("ok\n"));
-				state = S::Printing;
-			}
-		}
-		else if (sscanf_P(line, PSTR("R%d"), &value) > 0)
-		{
-			if (value == 0) //! R0 recover after eject filament
-			{
-				recover_after_eject();
-				fprintf_P(inout, PSTR("ok\n"));
-				state = S::Idle;
-			}
-		}
-        else if (sscanf_P(line, PSTR("W%d"), &value) > 0)
-        {
-            if (value == 0) //! W0 Wait for user click
-            {
-                state = S::Wait;
-            }
-        }
-        else if (sscanf_P(line, PSTR("K%d"), &value) > 0)
-        {
-            if ((value >= 0) && (value < EXTRUDERS)) //! K<nr.> cut filament
-            {
-#ifdef ENABLE_CUTTER
-                mmctl_cut_filament(value);
+//! @brief Printer sent 'A', its filament sensor detected filament tip
+//!
+//! Signal is consumed. Signal received before current command started is ignored.
+//! Constant time, the token is recognized by the UART1 receive interrupt.
+//! If the printer is connected to USB, commands are processed to find it.
+bool printer_filament_sensed()
+{
+#if (UART_COM == 0)
+	process_commands_background();
 #endif
-                fprintf_P(inout, PSTR("ok\n"));
-            }
-        }
-	}
-	else
-	{ //nothing received
-	}
+	return take_filament_sensed();
 }
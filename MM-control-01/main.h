@@ -11,6 +11,9 @@ void drive_error();
 void check_filament_not_present();
 void signal_load_failure(uint16_t rate);
 void signal_ok_after_load_failure();
+bool printer_filament_sensed();
+void send_event(const char* text);
+void send_frame(FILE* stream, uint8_t seq, uint8_t op, const uint8_t* payload, uint8_t length);
 
 extern uint8_t tmc2130_mode;
 extern FILE* uart_com;
@@ -11,11 +11,13 @@
 #include "tmc2130.h"
 #include "mmctl.h"
 #include "stepper.h"
+#include "step_engine.h"
 #include "Buttons.h"
 #include "motion.h"
 #include "permanent_storage.h"
 #include "config.h"
 #include "display.h"
+#include "phase.h"
 
 //! Keeps track of selected filament. It is used for LED signalization and it is backed up to permanent storage
 //! so MMU can unload filament after power loss.
@@ -28,6 +30,7 @@ const uint8_t finda_limit = 10;
 
 //! @brief Pull filament back from FINDA
 void retract_filament(int extra_steps) {
+  PhaseMark mark(Phase::RetractFilament);
   int _steps = get_pulley_steps(FILAMENT_RETRACT_MM) + extra_steps;  
 #ifdef SSD_DISPLAY
   display_message(MSG_RETRACTING);
@@ -35,11 +38,34 @@ void retract_filament(int extra_steps) {
 
   // unload from FINDA to rest position
   set_pulley_dir_pull();
-  for (int i=_steps; i>0; i--)
+  if (_steps > 0) do_pulley_steps(_steps, PULLEY_DELAY_PRIME);
+}
+
+//! @brief Pull filament back from FINDA, select next filament meanwhile
+//!
+//! Selector starts when FILAMENT_SELECTOR_CLEAR_MM of the retraction were pulled,
+//! the rest of the retraction runs together with selector travel.
+//! FILAMENT_SELECTOR_CLEAR_MM is a fixed margin, not a clearance measured from
+//! FINDA. Filament is assumed out of the selector well before the end of the
+//! retraction, where the selector used to start moving.
+//! @param filament filament to move idler and selector to
+static void retract_filament_select(uint8_t filament)
+{
+  PhaseMark mark(Phase::RetractFilament);
+  const int clear_steps = get_pulley_steps(FILAMENT_SELECTOR_CLEAR_MM);
+  const int _steps = get_pulley_steps(FILAMENT_RETRACT_MM);
+#ifdef SSD_DISPLAY
+  display_message(MSG_RETRACTING);
+#endif
+
+  set_pulley_dir_pull();
+  if (clear_steps >= _steps)
   {
-    do_pulley_step();
-    delayMicroseconds(PULLEY_DELAY_PRIME);
+    do_pulley_steps(_steps, PULLEY_DELAY_PRIME);
+    return;
   }
+  do_pulley_steps(clear_steps, PULLEY_DELAY_PRIME);
+  motion_set_idler_selector_retracting(filament, clear_steps - _steps);
 }
 
 //! @brief Feed filament to FINDA
@@ -76,7 +102,7 @@ bool feed_filament(bool timeout)
 
         for (unsigned int steps = 0; !timeout || (steps < 1500); ++steps)
         {
-            do_pulley_step();
+            do_pulley_step(PULLEY_DELAY_PRIME);
             ++blinker;
 
             if (blinker > 50)
@@ -100,8 +126,8 @@ bool feed_filament(bool timeout)
             {
                 break;
             }
-            delayMicroseconds(PULLEY_DELAY_PRIME);
         }
+        step_engine_wait();
 	}
 
 	if (loaded)
@@ -109,7 +135,7 @@ bool feed_filament(bool timeout)
     retract_filament(finda_limit*2);
 	}
 
-	tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+	tmc2130_disable_axis(AX_PUL);
 	motion_disengage_idler();
 	shr16_set_led(1 << 2 * (4 - active_extruder));
 	
@@ -182,7 +208,7 @@ void switch_extruder_withSensor(int new_extruder)
 
     if (isFilamentLoaded)
     {
-        unload_filament_withSensor(false);
+        unload_filament_withSensor(false, active_extruder);
     }
 
     motion_set_idler_selector(active_extruder);
@@ -246,19 +272,19 @@ void mmctl_cut_filament(uint8_t filament)
 
     for (int steps = 0; steps < cut_steps_pre; ++steps)
     {
-        do_pulley_step();
+        do_pulley_step(1500);
         steps++;
-        delayMicroseconds(1500);
     }
+    step_engine_wait();
     motion_set_idler_selector(filament, 0);
     set_pulley_dir_pull();
 
     for (int steps = 0; steps < cut_steps_post; ++steps)
     {
-        do_pulley_step();
+        do_pulley_step(1500);
         steps++;
-        delayMicroseconds(1500);
     }
+    step_engine_wait();
     motion_set_idler_selector(filament, 5);
     motion_set_idler_selector(filament, 0);
     motion_set_idler_selector(filament, filament);
@@ -290,13 +316,13 @@ void eject_filament(uint8_t filament)
 
     for (int steps = 0; steps < get_pulley_steps(FILAMENT_EJECT_MM); ++steps)
     {
-        do_pulley_step();
+        do_pulley_step(PULLEY_DELAY_EXTRUDER);
         steps++;
-        delayMicroseconds(PULLEY_DELAY_EXTRUDER);
     }
+    step_engine_wait();
 
     motion_disengage_idler();
-    tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+    tmc2130_disable_axis(AX_PUL);
 }
 
 //! @brief restore state before eject filament
@@ -307,14 +333,14 @@ void recover_after_eject()
     set_pulley_dir_pull();
     for (int steps = 0; steps < get_pulley_steps(FILAMENT_EJECT_MM); ++steps)
     {
-        do_pulley_step();
+        do_pulley_step(PULLEY_DELAY_EXTRUDER);
         steps++;
-        delayMicroseconds(PULLEY_DELAY_EXTRUDER);
     }
+    step_engine_wait();
     motion_disengage_idler();
 
     motion_set_idler_selector(active_extruder);
-    tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+    tmc2130_disable_axis(AX_PUL);
 }
 
 static bool checkOk()
@@ -332,11 +358,11 @@ static bool checkOk()
         _endstop_hit = 0;
         do
         {
-            do_pulley_step();
-            delayMicroseconds(PULLEY_DELAY_PRIME);
+            do_pulley_step(PULLEY_DELAY_PRIME);
             if (digitalRead(A1) == 0) _endstop_hit++;
             _steps--;
         } while (_steps > 0 && _endstop_hit < finda_limit);
+        step_engine_wait();
     }
 
     if (digitalRead(A1) == 0)
@@ -348,11 +374,11 @@ static bool checkOk()
         _endstop_hit = 0;
         do
         {
-            do_pulley_step();
-            delayMicroseconds(PULLEY_DELAY_PRIME);
+            do_pulley_step(PULLEY_DELAY_PRIME);
             if (digitalRead(A1) == 1) _endstop_hit++;
             _steps--;
         } while (_steps > 0 && _endstop_hit < finda_limit);
+        step_engine_wait();
 
         if (_steps == 0)
         {
@@ -388,7 +414,7 @@ bool mmctl_IsOk()
     motion_engage_idler();
     const bool retval = checkOk();
     motion_disengage_idler();
-    tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+    tmc2130_disable_axis(AX_PUL);
     return retval;
 }
 
@@ -410,19 +436,14 @@ void retry_finda(boolean state) {
 #endif
       // attempt to correct
       (state)?set_pulley_dir_push():set_pulley_dir_pull();
-      for (int i = get_pulley_steps(10); i >= 0; i--)
-      {
-        do_pulley_step();
-        delayMicroseconds(PULLEY_DELAY_PRIME/2);
-      }
+      do_pulley_steps(get_pulley_steps(10) + 1, PULLEY_DELAY_PRIME/2);
 
       (state)?set_pulley_dir_pull():set_pulley_dir_push();
       uint16_t _steps = get_pulley_steps( (state)?FILAMENT_BOWDEN_MM/2:100 );
       do
       {
-        do_pulley_step();
+        do_pulley_step(PULLEY_DELAY_PRIME*1.5);
         _steps--;
-        delayMicroseconds(PULLEY_DELAY_PRIME*1.5);
         if (!digitalRead(A1) == state) _endstop_hit++;
         if (buttonPressed() == Btn::middle)
         {
@@ -430,10 +451,12 @@ void retry_finda(boolean state) {
           delay(ButtonHold);  //de-bounce
           if (buttonPressed() == Btn::middle)
           {
+            step_engine_wait();
             return;
           }
         }
       } while (_endstop_hit<finda_limit && _steps > 0);
+      step_engine_wait();
     } else {
       return;
     }
@@ -637,11 +660,7 @@ void interactive_load_failure(boolean state) {
           motion_engage_idler();
           (state)?set_pulley_dir_pull():set_pulley_dir_push();
 
-          for (int i = 0; i < 200; i++)
-          {
-              do_pulley_step();
-              delayMicroseconds(PULLEY_DELAY_PRIME);
-          }
+          do_pulley_steps(200, PULLEY_DELAY_PRIME);
           motion_disengage_idler();
           break;
         case Btn::middle:
@@ -677,6 +696,7 @@ void interactive_load_failure(boolean state) {
 //!  * false Do not disengage idler after movement
 void load_filament_withSensor(bool disengageIdler)
 {
+    PhaseMark mark(Phase::LoadWithSensor);
     FilamentLoaded::set(active_extruder);
     motion_engage_idler();
 
@@ -687,6 +707,7 @@ void load_filament_withSensor(bool disengageIdler)
 
     // load filament until FINDA senses end of the filament, means correctly loaded into the selector
     boolean finda_success = false;
+    uint8_t retry = 0;
     while (!finda_success) {
 #ifdef SSD_DISPLAY
       display_message(MSG_PRIMING);
@@ -694,15 +715,16 @@ void load_filament_withSensor(bool disengageIdler)
       int _loadSteps = 0;
       do
       {
-          do_pulley_step();
+          do_pulley_step(PULLEY_DELAY_PRIME);
           _loadSteps++;
-          delayMicroseconds(PULLEY_DELAY_PRIME);
       } while (digitalRead(A1) == 0 && _loadSteps < get_pulley_steps(50));
+      step_engine_wait();
   
   
       // filament did not arrived at FINDA, let's try to correct that
       if (digitalRead(A1) == 0)
       {
+        event_retry(Phase::LoadWithSensor, ++retry);
         retry_finda(0);
       }
   
@@ -713,18 +735,20 @@ void load_filament_withSensor(bool disengageIdler)
         display_count_incr(COUNTER::LOAD_FAIL);
         display_error(MSG_LOADERROR);
 #endif
+        event_retry(Phase::LoadWithSensor, ++retry);
         interactive_load_failure(0);
       }
       else
       {
         //success
+        event_finda(1);
         finda_success = true;
       }
     }
 
     motion_feed_to_bondtech();
 
-    tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+    tmc2130_disable_axis(AX_PUL);
     if (disengageIdler) motion_disengage_idler();
     isFilamentLoaded = true;  // filament loaded
 #ifdef SSD_DISPLAY
@@ -732,7 +756,12 @@ void load_filament_withSensor(bool disengageIdler)
 #endif
 }
 
-void unload_filament_withSensor(bool disengageIdler)
+//! @brief Unload filament from extruder to rest position
+//! @param disengageIdler
+//!  * true Disengage idler after movement
+//!  * false Do not disengage idler after movement
+//! @param selector filament to select while retracting from FINDA, -1 do not select
+void unload_filament_withSensor(bool disengageIdler, int8_t selector)
 {
     // unloads filament from extruder - filament is above Bondtech gears
     tmc2130_init_axis(AX_PUL, tmc2130_mode);
@@ -753,15 +782,12 @@ void unload_filament_withSensor(bool disengageIdler)
     }
 
     // move a little bit so it is not a grinded hole in filament
-    for (int i = finda_limit; i > 0; i--)
-    {
-        do_pulley_step();
-        delayMicroseconds(PULLEY_DELAY_PRIME);
-    }
+    do_pulley_steps(finda_limit, PULLEY_DELAY_PRIME);
 
     // FINDA is still sensing filament, let's try to unload it once again
     if (digitalRead(A1) == 1)
     {
+      event_retry(Phase::UnloadToFinda, 1);
       retry_finda(1);
     }
 
@@ -778,12 +804,13 @@ void unload_filament_withSensor(bool disengageIdler)
     {
       // correct unloading
       // unload to PTFE tube
-      retract_filament();
+      if (selector < 0) retract_filament();
+      else retract_filament_select(selector);
     }
     if (disengageIdler) {
       motion_disengage_idler();
     }
-    tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+    tmc2130_disable_axis(AX_PUL);
     isFilamentLoaded = false; // filament unloaded
 #ifdef SSD_DISPLAY
     display_message(MSG_IDLE);
@@ -818,14 +845,9 @@ void load_filament_inPrinter()
 
     tmc2130_init_axis(AX_PUL, tmc2130_mode);
 
-    unsigned long _delay = fist_segment_delay;
-
     for (int i = 0; i < 770; i++)
     {
-        delayMicroseconds(_delay);
-        unsigned long now = micros();
-
-        if ('A' == getc(uart_com))
+        if (printer_filament_sensed())
         {
             motion_door_sensor_detected();
             break;
@@ -844,11 +866,11 @@ void load_filament_inPrinter()
         }
 #endif
         
-        do_pulley_step();
-        _delay = fist_segment_delay - (micros() - now);
+        do_pulley_step(fist_segment_delay);
     }
+    step_engine_wait();
 
-    tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+    tmc2130_disable_axis(AX_PUL);
     motion_disengage_idler();
 
 #ifdef SSD_DISPLAY
@@ -16,7 +16,7 @@ bool feed_filament(bool timeout = false);
 void enhanced_interactive_menu();
 void load_filament_withSensor(bool disengageIdler);
 void load_filament_inPrinter();
-void unload_filament_withSensor(bool disengageIdler);
+void unload_filament_withSensor(bool disengageIdler, int8_t selector = -1);
 void eject_filament(uint8_t filament);
 void recover_after_eject();
 void mmctl_cut_filament(uint8_t filament);
@@ -4,6 +4,7 @@
 
 #include "motion.h"
 #include "stepper.h"
+#include "step_engine.h"
 #include "permanent_storage.h"
 #include <Arduino.h>
 #include "main.h"
@@ -12,6 +13,8 @@
 #include "shr16.h"
 #include "mmctl.h"
 #include "display.h"
+#include "phase.h"
+#include "pulley_ramp.h"
 
 static uint8_t s_idler = 0;
 static uint8_t s_selector = 0;
@@ -19,6 +22,14 @@ static bool s_selector_homed = false;
 static bool s_idler_engaged = true;
 static bool s_has_door_sensor = false;
 
+//! @brief Store idler and selector position once they stand still long enough
+//!
+//! Lets the first selection after reset skip homing, see restore_position().
+void motion_persist_position()
+{
+    if (s_selector_homed) persist_position(s_idler, s_selector);
+}
+
 void rehome()
 {
     s_idler = 0;
@@ -57,15 +68,21 @@ void motion_set_idler_selector(uint8_t idler_selector)
 //! @param selector selector
 void motion_set_idler_selector(uint8_t idler, uint8_t selector)
 {
+    PhaseMark mark(Phase::SetIdlerSelector);
     int idler_steps = get_idler_steps(s_idler, idler);
     int selector_steps = get_selector_steps(s_selector, selector);
     
     if (!s_selector_homed)
     {
-            home();
-            s_selector = 0;
-            s_idler = 0;
+            if (!restore_position(s_idler, s_selector))
+            {
+                home();
+                s_selector = 0;
+                s_idler = 0;
+            }
             s_selector_homed = true;
+            idler_steps = get_idler_steps(s_idler, idler);
+            selector_steps = get_selector_steps(s_selector, selector);
     }
     
     if (idler_steps == 0  &&  selector_steps == 0)
@@ -89,6 +106,7 @@ void motion_set_idler_selector(uint8_t idler, uint8_t selector)
         {
             if (tries == i) unrecoverable_error();
             drive_error();
+            event_retry(Phase::SetIdlerSelector, i + 1);
             rehome();
         }
     }
@@ -98,6 +116,53 @@ void motion_set_idler_selector(uint8_t idler, uint8_t selector)
 #endif
 }
 
+//! @brief Move idler and selector to desired location while pulley finishes retraction
+//!
+//! Idler stays engaged and holds the filament until retraction is done. Selector
+//! travels as far as it can within the retraction time and finishes together
+//! with the pulley, the rest of selector travel runs together with idler travel.
+//! Filament has to be clear of the selector. If selector is not homed yet, only
+//! the pulley moves and selection is left to motion_set_idler_selector().
+//! In case of drive error re-home and select by motion_set_idler_selector().
+//!
+//! @param idler_selector idler and selector
+//! @param pulley_steps rest of retraction, negative pulls
+void motion_set_idler_selector_retracting(uint8_t idler_selector, int pulley_steps)
+{
+    if (!s_selector_homed)
+    {
+        move(0, 0, pulley_steps);
+        motion_set_idler_selector(idler_selector);
+        return;
+    }
+    PhaseMark mark(Phase::SetIdlerSelector);
+    const int idler_steps = get_idler_steps(s_idler, idler_selector);
+    const int selector_steps = get_selector_steps(s_selector, idler_selector);
+    const uint16_t overlap = min(get_steps_along_pulley(AX_SEL, abs(pulley_steps)), static_cast<uint16_t>(abs(selector_steps)));
+    const int selector_overlap = (selector_steps < 0) ? -overlap : overlap;
+
+#ifdef SSD_DISPLAY
+    display_message(MSG_SELECTING);
+    display_extruder(-1);
+#endif
+    move(0, selector_overlap, pulley_steps);
+    move(idler_steps, selector_steps - selector_overlap, 0);
+    s_idler = idler_selector;
+    s_selector = idler_selector;
+#ifdef SSD_DISPLAY
+    display_message(MSG_IDLE);
+    display_extruder();
+#endif
+
+    if (tmc2130_read_gstat())
+    {
+        drive_error();
+        event_retry(Phase::SetIdlerSelector, 1);
+        rehome();
+        motion_set_idler_selector(idler_selector);
+    }
+}
+
 static void check_idler_drive_error()
 {
     const uint8_t tries = 2;
@@ -130,44 +195,46 @@ void motion_disengage_idler()
 //! @brief unload until FINDA senses end of the filament
 static void unload_to_finda()
 {
+    PhaseMark mark(Phase::UnloadToFinda);
 #ifdef SSD_DISPLAY
     display_message(MSG_UNLOADING);
 #endif
     uint16_t steps = get_pulley_steps(FILAMENT_BOWDEN_MM);
-    uint16_t steps_acc = get_pulley_acceleration_steps(PULLEY_DELAY_PRIME, PULLEY_DELAY_UNLOAD);
-    uint16_t steps_dec = get_pulley_acceleration_steps(PULLEY_DELAY_UNLOAD, PULLEY_DELAY_PRIME);
+    const uint16_t steps_acc = pulley_ramp_steps(PULLEY_DELAY_PRIME, PULLEY_DELAY_UNLOAD);
+    const uint16_t steps_dec = pulley_ramp_steps(PULLEY_DELAY_UNLOAD, PULLEY_DELAY_PRIME);
+    const uint16_t ramp_unload = pulley_ramp::index(PULLEY_DELAY_UNLOAD);
     uint16_t steps_extra = get_pulley_steps(FILAMENT_FINDA_EXIT_MM+12);
     uint8_t _endstop_hit = 0;
     
     set_pulley_dir_pull();
-    uint16_t delay = PULLEY_DELAY_PRIME;
-    uint16_t stepPeriod = PULLEY_DELAY_PRIME;
+    uint16_t ramp = 0;
     uint16_t _steps = steps + steps_extra;
 
     while (_endstop_hit < finda_limit && _steps > 0)
     {
-        delayMicroseconds(delay);
-        unsigned long now = micros();
-        
-        do_pulley_step();
+        if (_steps > steps-steps_acc  &&  ramp < ramp_unload)  { ++ramp; }
+        if (_steps < steps_dec+steps_extra  &&  ramp > 0)  { --ramp; }
 
-        if (_steps > steps-steps_acc  &&  stepPeriod > PULLEY_DELAY_UNLOAD)  { stepPeriod = (float)stepPeriod * PULLEY_ACCELERATION_X; }
-        if (_steps < steps_dec+steps_extra  &&  stepPeriod < PULLEY_DELAY_PRIME)  { stepPeriod = (float)stepPeriod / PULLEY_ACCELERATION_X; }
+        do_pulley_step(pulley_ramp_period(ramp));
 
         if (digitalRead(A1) == 0) _endstop_hit++;
-        delay = stepPeriod - (micros() - now);
         _steps--;
     }
+    step_engine_wait();
+    if (_endstop_hit >= finda_limit) event_finda(0);
 }
 
 void motion_feed_to_bondtech()
 {
+    PhaseMark mark(Phase::FeedToBondtech);
 #ifdef SSD_DISPLAY
     display_message(MSG_LOADING);
 #endif
     uint16_t steps = get_pulley_steps(FILAMENT_BOWDEN_MM);
-    uint16_t steps_acc = get_pulley_acceleration_steps(PULLEY_DELAY_PRIME, PULLEY_DELAY_LOAD);
-    uint16_t steps_dec = get_pulley_acceleration_steps(PULLEY_DELAY_LOAD, PULLEY_DELAY_EXTRUDER);
+    const uint16_t steps_acc = pulley_ramp_steps(PULLEY_DELAY_PRIME, PULLEY_DELAY_LOAD);
+    const uint16_t steps_dec = pulley_ramp_steps(PULLEY_DELAY_LOAD, PULLEY_DELAY_EXTRUDER);
+    const uint16_t ramp_load = pulley_ramp::index(PULLEY_DELAY_LOAD);
+    const uint16_t ramp_extruder = pulley_ramp::index(PULLEY_DELAY_EXTRUDER);
     uint16_t steps_extra = get_pulley_steps(5);
     uint16_t steps_exit = get_pulley_steps(FILAMENT_FINDA_EXIT_MM);
     
@@ -181,32 +248,30 @@ void motion_feed_to_bondtech()
         }
 #endif
         set_pulley_dir_push();
-        uint16_t delay = PULLEY_DELAY_PRIME;
-        uint16_t stepPeriod = PULLEY_DELAY_PRIME;
+        uint16_t ramp = 0;
         for (uint16_t i = 0; i < steps_exit+steps+steps_extra; i++)
         {
-            delayMicroseconds(delay);
-            unsigned long now = micros();
-
-            if (i >= steps_exit && i <= steps_exit+steps_acc  &&  stepPeriod > PULLEY_DELAY_LOAD)  { stepPeriod = (float)stepPeriod * PULLEY_ACCELERATION_X; }
-            if (i > steps-steps_dec-steps_extra  &&  stepPeriod < PULLEY_DELAY_EXTRUDER)  { stepPeriod = (float)stepPeriod / PULLEY_ACCELERATION_X; }
+            if (i >= steps_exit && i <= steps_exit+steps_acc  &&  ramp < ramp_load)  { ++ramp; }
+            if (i > steps-steps_dec-steps_extra  &&  ramp > ramp_extruder)  { --ramp; }
 
-           if ('A' == getc(uart_com))
+           if (printer_filament_sensed())
             {
+                step_engine_wait();
                 s_has_door_sensor = true;
-                tmc2130_disable_axis(AX_PUL, tmc2130_mode);
+                tmc2130_disable_axis(AX_PUL);
                 motion_disengage_idler();
                 return;
             }
-            do_pulley_step();
-            delay = stepPeriod - (micros() - now);
+            do_pulley_step(pulley_ramp_period(ramp));
         }
+        step_engine_wait();
 
         if (!tmc2130_read_gstat()) break;
         else
         {
             if (tries == tr) unrecoverable_error();
             drive_error();
+            event_retry(Phase::FeedToBondtech, tr + 1);
             rehome_idler();
             unload_to_finda();
         }
@@ -234,6 +299,7 @@ void motion_unload_to_finda()
         {
             if (tries == tr) unrecoverable_error();
             drive_error();
+            event_retry(Phase::UnloadToFinda, tr + 1);
             rehome_idler();
         }
         else
@@ -249,13 +315,21 @@ void motion_door_sensor_detected()
     s_has_door_sensor = true;
 }
 
+//! @brief Move idler to filament after reset
+//!
+//! Idler is homed, unless position stored before reset can be restored.
 void motion_set_idler(uint8_t idler)
 {
-    home_idler();
+    if (!s_selector_homed && restore_position(s_idler, s_selector)) s_selector_homed = true;
+    if (!s_selector_homed)
+    {
+        home_idler();
+        s_idler = 0;
+    }
 #ifdef SSD_DISPLAY
     display_message(MSG_SELECTING);
 #endif
-    int idler_steps = get_idler_steps(0, idler);
+    int idler_steps = get_idler_steps(s_idler, idler);
     move(idler_steps, 0, 0);
     s_idler = idler;
     
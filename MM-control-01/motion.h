@@ -16,6 +16,8 @@ void motion_feed_to_bondtech();
 void motion_unload_to_finda();
 void motion_door_sensor_detected();
 void motion_set_idler(uint8_t idler);
+void motion_set_idler_selector_retracting(uint8_t idler_selector, int pulley_steps);
+void motion_persist_position();
 void rehome();
 
 #endif //MOTION_H_
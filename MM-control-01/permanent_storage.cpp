@@ -22,6 +22,8 @@ typedef struct __attribute__ ((packed))
 	uint8_t eepromFilament[800];    //!< Top nibble status, bottom nibble last filament loaded
 	uint8_t eepromDriveErrorCountH;
 	uint8_t eepromDriveErrorCountL[2];
+	uint8_t eepromHomedPositionStatus[3];   //!< Majority vote status of eepromHomedPosition wear leveling
+	uint8_t eepromHomedPosition[48][4];     //!< Top nibble status + clean flag, idler + selector, idler MSCNT / 4, selector MSCNT / 4
 }eeprom_t;
 static_assert(sizeof(eeprom_t) - 2 <= E2END, "eeprom_t doesn't fit into EEPROM available.");
 //! @brief EEPROM layout version
@@ -375,3 +377,120 @@ void DriveError::setH(uint8_t highByte)
 {
     eeprom_update_byte(&(eepromBase->eepromDriveErrorCountH), highByte - 1);
 }
+
+//! @brief Get homed position storage status
+//!
+//! Uses 2 out of 3 majority vote.
+//!
+//! @return status
+//! @retval 0xff Uninitialized EEPROM or no 2 values agrees
+uint8_t HomedPosition::getStatus()
+{
+    const uint8_t first = eeprom_read_byte(&(eepromBase->eepromHomedPositionStatus[0]));
+    const uint8_t second = eeprom_read_byte(&(eepromBase->eepromHomedPositionStatus[1]));
+    const uint8_t third = eeprom_read_byte(&(eepromBase->eepromHomedPositionStatus[2]));
+    if (first == second || first == third) return first;
+    if (second == third) return second;
+    return 0xff;
+}
+
+//! @brief Set homed position storage status
+//!
+//! @retval true Succeed
+//! @retval false Failed
+bool HomedPosition::setStatus(uint8_t status)
+{
+    for (uint8_t i = 0; i < ARR_SIZE(eeprom_t::eepromHomedPositionStatus); ++i)
+    {
+        eeprom_update_byte(&(eepromBase->eepromHomedPositionStatus[i]), status);
+    }
+    return (getStatus() == status);
+}
+
+//! @brief Get index of last record written with current status
+//!
+//! @return index to eepromHomedPosition[]
+//! @retval -1 no record, or invalid status
+int16_t HomedPosition::getIndex()
+{
+    const uint8_t status = getStatus();
+    if (status != Key1 && status != Key2) return -1;
+    for (uint8_t i = 0; i < ARR_SIZE(eeprom_t::eepromHomedPosition); ++i)
+    {
+        if (status != (eeprom_read_byte(&(eepromBase->eepromHomedPosition[i][0])) >> 4)) return i - 1;
+    }
+    return ARR_SIZE(eeprom_t::eepromHomedPosition) - 1;
+}
+
+//! @brief Get position stored by set(), unless it was invalidated
+//! @param [out] position
+//! @retval true success
+//! @retval false no valid record, or invalidated
+bool HomedPosition::get(Position &position)
+{
+    const int16_t index = getIndex();
+    if (index < 0) return false;
+    const uint8_t * const record = eepromBase->eepromHomedPosition[index];
+    if (!(eeprom_read_byte(&record[0]) & 1)) return false;
+    const uint8_t axes = eeprom_read_byte(&record[1]);
+    position.idler = axes >> 4;
+    position.selector = axes & 0x0f;
+    position.idlerMscnt = eeprom_read_byte(&record[2]) << 2;
+    position.selectorMscnt = eeprom_read_byte(&record[3]) << 2;
+    return true;
+}
+
+//! @brief Write and verify record
+//!
+//! Key is written last. Key of the following record is cleared first if it
+//! matches, so that getIndex() does not run past this record into records
+//! left from an earlier use of the same key.
+bool HomedPosition::write(uint8_t status, int16_t index, const Position &position)
+{
+    if (static_cast<uint16_t>(index + 1) < ARR_SIZE(eeprom_t::eepromHomedPosition))
+    {
+        uint8_t * const next = eepromBase->eepromHomedPosition[index + 1];
+        if (status == (eeprom_read_byte(&next[0]) >> 4)) eeprom_update_byte(&next[0], 0xff);
+    }
+    uint8_t raw[4];
+    raw[0] = (status << 4) | 1;
+    raw[1] = (position.idler << 4) | (position.selector & 0x0f);
+    raw[2] = position.idlerMscnt >> 2;
+    raw[3] = position.selectorMscnt >> 2;
+    uint8_t * const record = eepromBase->eepromHomedPosition[index];
+    for (int8_t i = 3; i >= 0; --i) eeprom_update_byte(&record[i], raw[i]);
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        if (eeprom_read_byte(&record[i]) != raw[i]) return false;
+    }
+    return true;
+}
+
+//! @brief Store position as clean record
+//!
+//! Writes to slot following the last record. If the end is reached or write
+//! fails, key is switched and record is written to the first slot.
+//! @param position idler and selector 0 to 15
+//! @retval true success
+//! @retval false failed
+bool HomedPosition::set(const Position &position)
+{
+    uint8_t status = getStatus();
+    int16_t index = getIndex() + 1;
+    if ((status == Key1 || status == Key2)
+        && (static_cast<uint16_t>(index) < ARR_SIZE(eeprom_t::eepromHomedPosition))
+        && write(status, index, position)) return true;
+
+    status = (status == Key1) ? Key2 : Key1;
+    if (!setStatus(status)) return false;
+    return write(status, 0, position);
+}
+
+//! @brief Clear clean flag of last record
+void HomedPosition::invalidate()
+{
+    const int16_t index = getIndex();
+    if (index < 0) return;
+    uint8_t * const record = eepromBase->eepromHomedPosition[index];
+    eeprom_update_byte(&record[0], eeprom_read_byte(&record[0]) & ~1);
+}
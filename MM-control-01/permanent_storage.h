@@ -78,6 +78,45 @@ private:
     static void getNext(uint8_t &status);
 };
 
+//! @brief Read and store idler and selector position for restoring it after reset
+//!
+//! 48 records of 4 bytes + 3(status) EEPROM cells are used, each record is written
+//! to the next free slot and can be invalidated once in place by clearing its clean flag.
+//! Status use 2 of 3 majority vote and holds the key of valid records. When the last
+//! slot is used, key alternates and writing starts again at the first slot.
+//! The byte holding the key is written last, so a record interrupted by power loss is not valid.
+//!
+//! Records are stored by the firmware only after idler and selector stood still
+//! for a while, limiting it to a store and an invalidation per minute:
+//! @n Cell written per hour : 60 * 2 / 48 = 2.5
+//! @n First cell failure expected: 100 000 / 2.5 = 40 000 hours
+//!
+//! A failed record write switches key and starts again at the first slot.
+class HomedPosition
+{
+public:
+    struct Position
+    {
+        uint8_t idler;          //!< 0 to 15
+        uint8_t selector;       //!< 0 to 15
+        uint16_t idlerMscnt;    //!< TMC2130 MSCNT of idler, multiple of 4
+        uint16_t selectorMscnt; //!< TMC2130 MSCNT of selector, multiple of 4
+    };
+    static bool get(Position &position);
+    static bool set(const Position &position);
+    static void invalidate();
+private:
+    enum Key
+    {
+        Key1,
+        Key2,
+    };
+    static uint8_t getStatus();
+    static bool setStatus(uint8_t status);
+    static int16_t getIndex();
+    static bool write(uint8_t status, int16_t index, const Position &position);
+};
+
 //! @brief Read and increment drive errors
 //!
 //! (Motor power rail voltage loss)
@@ -0,0 +1,46 @@
+//! @file
+//! @brief Tool change phase markers
+//!
+//! Marks the motion phases a tool change consists of. The host simulator
+//! measures their duration. On the MMU the markers only push progress
+//! events to the printer, see event.h.
+
+#ifndef PHASE_H_
+#define PHASE_H_
+
+#include <stdint.h>
+#include "event.h"
+
+enum class Phase : uint8_t
+{
+    UnloadToFinda,      //!< unload_to_finda()
+    RetractFilament,    //!< retract_filament()
+    SetIdlerSelector,   //!< motion_set_idler_selector()
+    LoadWithSensor,     //!< load_filament_withSensor()
+    FeedToBondtech,     //!< motion_feed_to_bondtech()
+    HomeIdler,          //!< home_idler()
+    HomeSelector,       //!< home_selector()
+    Count,
+};
+
+#ifdef MMU_SIMULATOR
+void phase_begin(Phase phase);
+void phase_end(Phase phase);
+#else
+inline void phase_begin(Phase) {}
+inline void phase_end(Phase) {}
+#endif //MMU_SIMULATOR
+
+//! @brief Marks phase for the lifetime of the object
+class PhaseMark
+{
+public:
+    explicit PhaseMark(Phase phase) : m_phase(phase) { phase_begin(phase); event_phase_begin(phase); }
+    ~PhaseMark() { event_phase_end(m_phase); phase_end(m_phase); }
+private:
+    PhaseMark(const PhaseMark&);
+    PhaseMark& operator=(const PhaseMark&);
+    Phase m_phase;
+};
+
+#endif //PHASE_H_
@@ -7,45 +7,45 @@
 
 const uint8_t selector_step_pin = 0x10;
 
-void selector_step_pin_init()
+static inline void selector_step_pin_init()
 {
     DDRD |= selector_step_pin;
 }
-inline void selector_step_pin_set()
+static inline void selector_step_pin_set()
 {
     PORTD |= selector_step_pin;
 }
-void selector_step_pin_reset()
+static inline void selector_step_pin_reset()
 {
     PORTD &= ~selector_step_pin;
 }
 
 const uint8_t idler_step_pin = 0x40;
 
-void idler_step_pin_init()
+static inline void idler_step_pin_init()
 {
     DDRD |= idler_step_pin;
 }
-inline void idler_step_pin_set()
+static inline void idler_step_pin_set()
 {
     PORTD |= idler_step_pin;
 }
-void idler_step_pin_reset()
+static inline void idler_step_pin_reset()
 {
     PORTD &= ~idler_step_pin;
 }
 
 const uint8_t pulley_step_pin = 0x10;
 
-void pulley_step_pin_init()
+static inline void pulley_step_pin_init()
 {
     DDRB |= pulley_step_pin;
 }
-inline void pulley_step_pin_set()
+static inline void pulley_step_pin_set()
 {
     PORTB |= pulley_step_pin;
 }
-void pulley_step_pin_reset()
+static inline void pulley_step_pin_reset()
 {
     PORTB &= ~pulley_step_pin;
 }
@@ -0,0 +1,83 @@
+//! @file
+//! @brief Pulley acceleration ramp generated at compile time
+//!
+//! Each ramp step multiplies the step period by PULLEY_ACCELERATION_X and drops
+//! 0.5 us, the mean loss of the integer truncation of the former per step
+//! stepPeriod = (float)stepPeriod * PULLEY_ACCELERATION_X update, which the
+//! acceleration factors of the profiles were tuned with. Solved for step k:
+//! (PULLEY_DELAY_PRIME + t) * PULLEY_ACCELERATION_X^k - t, t = 0.5 / (1 - PULLEY_ACCELERATION_X).
+//!
+//! The table starts at PULLEY_DELAY_PRIME and ends at the shorter of PULLEY_DELAY_LOAD
+//! and PULLEY_DELAY_UNLOAD. Motion loops accelerate by incrementing the ramp index
+//! and decelerate by decrementing it, no floating point math is done while stepping.
+
+#ifndef PULLEY_RAMP_H_
+#define PULLEY_RAMP_H_
+
+#include <stdint.h>
+#include <math.h>
+#include <avr/pgmspace.h>
+#include "config.h"
+#include "index_sequence.h"
+
+namespace pulley_ramp
+{
+
+constexpr float square(float v)
+{
+    return v * v;
+}
+
+//! @brief x^n, recursion depth log2(n)
+constexpr float power(float x, uint16_t n)
+{
+    return (n == 0) ? 1.0f : (((n & 1) ? x : 1.0f) * square(power(x, n / 2)));
+}
+
+constexpr float truncation = 0.5f / (1.0f - PULLEY_ACCELERATION_X);
+
+//! @brief Ramp step period [us]
+constexpr uint16_t period(uint16_t index)
+{
+    return static_cast<uint16_t>((PULLEY_DELAY_PRIME + truncation) * power(PULLEY_ACCELERATION_X, index) - truncation + 0.5f);
+}
+
+//! @brief Ramp index of first period not longer than delay
+constexpr uint16_t index(float delay)
+{
+    return (delay >= PULLEY_DELAY_PRIME) ? 0
+        : static_cast<uint16_t>(ceil(log((delay + truncation) / (PULLEY_DELAY_PRIME + truncation)) / log(PULLEY_ACCELERATION_X)));
+}
+
+constexpr uint16_t last = (PULLEY_DELAY_LOAD < PULLEY_DELAY_UNLOAD) ? index(PULLEY_DELAY_LOAD) : index(PULLEY_DELAY_UNLOAD);
+
+template<typename S> struct Table;
+template<uint16_t... I> struct Table<IndexSequence<I...> >
+{
+    static const uint16_t period[sizeof...(I)];
+};
+template<uint16_t... I> const uint16_t Table<IndexSequence<I...> >::period[sizeof...(I)] PROGMEM = {pulley_ramp::period(I)...};
+
+typedef Table<MakeIndexSequence<last + 1>::Type> Periods;
+
+} // namespace pulley_ramp
+
+//! @brief Pulley step period at ramp index
+//! @param index 0 (PULLEY_DELAY_PRIME) to pulley_ramp::last
+//! @return step period [us]
+inline uint16_t pulley_ramp_period(uint16_t index)
+{
+    return pgm_read_word(&pulley_ramp::Periods::period[index]);
+}
+
+//! @brief Number of ramp steps between two step periods
+//! @param delay_start step period [us]
+//! @param delay_end step period [us]
+constexpr uint16_t pulley_ramp_steps(float delay_start, float delay_end)
+{
+    return (pulley_ramp::index(delay_start) > pulley_ramp::index(delay_end))
+        ? (pulley_ramp::index(delay_start) - pulley_ramp::index(delay_end))
+        : (pulley_ramp::index(delay_end) - pulley_ramp::index(delay_start));
+}
+
+#endif //PULLEY_RAMP_H_
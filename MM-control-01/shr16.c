@@ -61,9 +61,10 @@ void shr16_set_dir(uint8_t dir)
 	shr16_write((shr16_v & ~SHR16_DIR_MSK) | dir);
 }
 
+//! @return enabled axes, same bits as shr16_set_ena()
 uint8_t shr16_get_ena(void)
 {
-	return ((shr16_v & 2) >> 1) | ((shr16_v & 8) >> 2) | ((shr16_v & 0x20) >> 3);
+	return (((shr16_v & 2) >> 1) | ((shr16_v & 8) >> 2) | ((shr16_v & 0x20) >> 3)) ^ 7;
 }
 
 uint8_t shr16_get_dir(void)
@@ -0,0 +1,203 @@
+//! @file
+//! @brief Interrupt driven step generator
+
+#include "step_engine.h"
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "config.h"
+#include "pins.h"
+
+namespace
+{
+
+//! @brief Steps of several axes at constant rate
+struct Segment
+{
+    uint8_t axes;    //!< axes stepping every tick, line_axes for interpolated line
+    uint16_t steps;  //!< steps left, decremented by the interrupt
+    uint16_t ticks;  //!< OCR1A value, (period - 1) in timer ticks
+};
+
+//! Short queue keeps the steps queued after a FINDA or 'A' reaction small
+const uint8_t queue_size = 4; //!< power of 2
+const uint8_t ticks_per_us = 2; //!< F_CPU / 8
+const uint16_t start_ticks = 32; //!< delay of first step after the engine was idle
+const uint8_t line_axes = 0x80; //!< Segment::axes of interpolated line
+
+volatile Segment s_queue[queue_size];
+volatile uint8_t s_head = 0; //!< written by main loop only
+volatile uint8_t s_tail = 0; //!< written by interrupt only
+uint8_t s_wait_queued; //!< step_engine_wait_queued() limit
+volatile uint16_t s_steps[3]; //!< step_engine_steps(), written by interrupt only
+
+//! @name Bresenham state of the line, written by step_engine_line() while idle
+//! @{
+uint16_t s_line_steps[3]; //!< steps of each axis
+uint16_t s_line_ticks;    //!< steps of the axis with most steps
+int16_t s_line_error[3];  //!< written by interrupt while running
+//! @}
+
+inline uint8_t next(uint8_t index)
+{
+    return (index + 1) & (queue_size - 1);
+}
+
+inline bool queue_full()
+{
+    return next(s_head) == s_tail;
+}
+
+//! @brief Sleep until the next interrupt if condition holds
+//!
+//! Interrupts are enabled by the instruction preceding sleep, so an interrupt
+//! which changes the condition after it was evaluated can not be missed.
+//! @retval true condition held, slept
+//! @retval false condition did not hold
+bool sleep_while(bool (*condition)())
+{
+    cli();
+    if (!condition())
+    {
+        sei();
+        return false;
+    }
+    sleep_enable();
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    return true;
+}
+
+bool more_queued()
+{
+    return step_engine_queued() > s_wait_queued;
+}
+
+} // unnamed namespace
+
+void step_engine_init()
+{
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    TIMSK1 &= ~(1 << OCIE1A);
+    TCCR1A = 0;
+    TCCR1B = (1 << WGM12) | (1 << CS11); //CTC, F_CPU / 8
+}
+
+void step_engine_queue(uint8_t axes, uint16_t steps, uint16_t period)
+{
+    if (!steps) return;
+    while (sleep_while(queue_full)) yield();
+
+    volatile Segment &segment = s_queue[s_head];
+    segment.axes = axes;
+    segment.steps = steps;
+    segment.ticks = static_cast<uint16_t>(period * ticks_per_us) - 1;
+    s_head = next(s_head);
+
+    if (!step_engine_busy())
+    {
+        TCNT1 = 0;
+        OCR1A = start_ticks;
+        TIFR1 = (1 << OCF1A);
+        TIMSK1 |= (1 << OCIE1A);
+    }
+}
+
+void step_engine_line(const uint16_t steps[3])
+{
+    step_engine_wait();
+    s_line_ticks = 0;
+    for (uint8_t axis = 0; axis < 3; ++axis)
+    {
+        s_line_steps[axis] = steps[axis];
+        if (steps[axis] > s_line_ticks) s_line_ticks = steps[axis];
+    }
+    for (uint8_t axis = 0; axis < 3; ++axis) s_line_error[axis] = s_line_ticks / 2;
+}
+
+void step_engine_queue_line(uint16_t ticks, uint16_t period)
+{
+    step_engine_queue(line_axes, ticks, period);
+}
+
+uint8_t step_engine_queued()
+{
+    return (s_head - s_tail) & (queue_size - 1);
+}
+
+void step_engine_wait_queued(uint8_t segments)
+{
+    s_wait_queued = segments;
+    while (sleep_while(more_queued)) yield();
+}
+
+void step_engine_stop()
+{
+    cli();
+    TIMSK1 &= ~(1 << OCIE1A);
+    s_head = s_tail;
+    sei();
+}
+
+uint16_t step_engine_steps(uint8_t axis)
+{
+    cli();
+    const uint16_t steps = s_steps[axis];
+    sei();
+    return steps;
+}
+
+bool step_engine_busy()
+{
+    return TIMSK1 & (1 << OCIE1A);
+}
+
+void step_engine_wait()
+{
+    while (sleep_while(step_engine_busy)) yield();
+}
+
+//! @brief Execute one step of the oldest segment
+//!
+//! A line segment steps each axis when its Bresenham error underflows, so the
+//! steps of each axis are spread evenly over the ticks of the line.
+//! Period of the step is loaded to OCR1A, the engine stops one period after
+//! the last step when the queue is empty.
+ISR(TIMER1_COMPA_vect)
+{
+    if (s_tail == s_head)
+    {
+        TIMSK1 &= ~(1 << OCIE1A);
+        return;
+    }
+    volatile Segment &segment = s_queue[s_tail];
+    uint8_t axes = segment.axes;
+    if (axes == line_axes)
+    {
+        axes = 0;
+        for (uint8_t axis = 0; axis < 3; ++axis)
+        {
+            s_line_error[axis] -= s_line_steps[axis];
+            if (s_line_error[axis] < 0)
+            {
+                s_line_error[axis] += s_line_ticks;
+                axes |= 1 << axis;
+            }
+        }
+    }
+    if (axes & (1 << AX_PUL)) pulley_step_pin_set();
+    if (axes & (1 << AX_SEL)) selector_step_pin_set();
+    if (axes & (1 << AX_IDL)) idler_step_pin_set();
+    asm("nop");
+    if (axes & (1 << AX_PUL)) pulley_step_pin_reset();
+    if (axes & (1 << AX_SEL)) selector_step_pin_reset();
+    if (axes & (1 << AX_IDL)) idler_step_pin_reset();
+    for (uint8_t axis = 0; axis < 3; ++axis)
+    {
+        if (axes & (1 << axis)) ++s_steps[axis];
+    }
+    OCR1A = segment.ticks;
+    if (!--segment.steps) s_tail = next(s_tail);
+}
@@ -0,0 +1,66 @@
+//! @file
+//! @brief Interrupt driven step generator
+//!
+//! Step segments are queued by motion code and executed by the Timer1
+//! compare match interrupt. Step timing does not depend on what the
+//! main loop does between steps.
+
+#ifndef STEP_ENGINE_H_
+#define STEP_ENGINE_H_
+
+#include <stdint.h>
+
+void step_engine_init();
+
+//! @brief Queue steps of one or more axes at constant rate
+//!
+//! Each step is followed by period before the next queued step.
+//! Waits for free space in the queue, starts the engine if it is idle.
+//! Direction of the axes has to be set before queuing and must not change
+//! until step_engine_wait() returns.
+//!
+//! @param axes bit mask of axes to step, (1 << AX_PUL) | (1 << AX_SEL) | (1 << AX_IDL)
+//! @param steps number of steps, 0 does nothing
+//! @param period time between steps [us], 1 to 32767
+void step_engine_queue(uint8_t axes, uint16_t steps, uint16_t period);
+
+//! @brief Start a line, axes step evenly spread so that all of them finish together
+//!
+//! Waits until all queued steps are done. The line consists of as many ticks as
+//! the axis with most steps has steps, ticks are queued by step_engine_queue_line().
+//! Direction of the axes has to be set before.
+//!
+//! @param steps steps of each axis, indexed by AX_PUL, AX_SEL, AX_IDL, 0 to 16383
+void step_engine_line(const uint16_t steps[3]);
+
+//! @brief Queue ticks of the line started by step_engine_line() at constant rate
+//!
+//! @param ticks number of ticks, the sum of all ticks queued has to match the line
+//! @param period time between ticks [us], 1 to 32767
+void step_engine_queue_line(uint16_t ticks, uint16_t period);
+
+//! @brief Number of queued segments including the running one
+uint8_t step_engine_queued();
+
+//! @brief Wait until no more than segments are queued
+//!
+//! Keeps steps running while the caller does something between queuing.
+//! Calls yield() while waiting.
+void step_engine_wait_queued(uint8_t segments);
+
+//! @brief Abort running and queued steps
+void step_engine_stop();
+
+//! @brief Steps done by axis since power on, wraps around
+//! @param axis AX_PUL, AX_SEL or AX_IDL
+uint16_t step_engine_steps(uint8_t axis);
+
+//! @brief Are steps queued or running?
+bool step_engine_busy();
+
+//! @brief Wait until all queued steps are done
+//!
+//! Calls yield() while waiting.
+void step_engine_wait();
+
+#endif //STEP_ENGINE_H_
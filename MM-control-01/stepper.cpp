@@ -12,10 +12,19 @@
 #include "pins.h"
 #include "tmc2130.h"
 #include "display.h"
+#include "step_engine.h"
+#include "axis_ramp.h"
+#include "phase.h"
 
 int8_t filament_type[EXTRUDERS];
 
 static bool isIdlerParked = false;
+static HomingResult s_homing_result[3] = {HomingResult::None, HomingResult::None, HomingResult::None};
+static bool s_position_persisted = false; //!< clean HomedPosition record matches idler and selector
+static bool s_drive_reset = false; //!< idler or selector driver reported reset or error at boot
+static bool s_approaching = false; //!< approach_stall() is running
+static uint32_t s_last_move = 0; //!< [ms]
+const uint32_t persist_delay = 60000; //!< idler and selector stand still before storing position [ms]
 static int set_idler_direction(int _steps);
 static int set_selector_direction(int _steps);
 static int set_pulley_direction(int _steps);
@@ -46,15 +55,6 @@ int get_selector_steps(int current_filament, int next_filament)
   }
 }
 
-//! @brief Compute number of steps to reach full speed
-//! @param delay_start Initial delay
-//! @param delay_end Final delay
-//! @return Steps
-int get_pulley_acceleration_steps(int16_t delay_start, int16_t delay_end) {
-  float delay_diff = (float)min(delay_start, delay_end) / (float)max(delay_start, delay_end);
-  return ceil( log(delay_diff) / log(PULLEY_ACCELERATION_X) );
-}
-
 
 //! @brief Compute steps for idler needed to change filament
 //! @param current_filament Currently selected filament
@@ -65,59 +65,140 @@ int get_idler_steps(int current_filament, int next_filament)
     return ((current_filament - next_filament) * IDLER_STEPS);
 }
 
-void do_pulley_step()
+//! @brief Compute steps an axis can do in a line with the pulley without slowing it
+//!
+//! move() runs the pulley at PULLEY_DELAY_PRIME and interpolates the other axes,
+//! so they run at constant rate too. The line is not stretched as long as the
+//! axis rate stays at or below its start rate.
+//! @param axis AX_SEL or AX_IDL
+//! @param pulley_steps pulley steps of the line
+//! @return steps
+uint16_t get_steps_along_pulley(uint8_t axis, uint16_t pulley_steps)
+{
+    return static_cast<uint32_t>(pulley_steps) * static_cast<uint16_t>(PULLEY_DELAY_PRIME) / axis_ramp_period(axis, 0);
+}
+
+//! @brief Queue one pulley step
+//! @param period time to next step [us]
+void do_pulley_step(uint16_t period)
 {
-    pulley_step_pin_set();
-	asm("nop");
-	pulley_step_pin_reset();
-	asm("nop");
+    step_engine_queue(1 << AX_PUL, 1, period);
 }
 
+//! @brief Do pulley steps at constant rate, return when done
+//! @param steps number of steps
+//! @param period time between steps [us]
+void do_pulley_steps(uint16_t steps, uint16_t period)
+{
+    step_engine_queue(1 << AX_PUL, steps, period);
+    step_engine_wait();
+}
 
 
 
-//! @brief home idler
+
+//! @brief Approach end stop until StallGuard reports stall
+//!
+//! Steps are queued at start rate, StallGuard limits are tuned for it.
+//! In fast mode steps are queued in bursts, StallGuard is read once per burst
+//! and at most two bursts are queued, so the axis overruns the stall by less than that.
+//! StallGuard read is requested before the next burst is queued and completes
+//! meanwhile, the burst is dropped on stall.
+//! @param axis AX_SEL or AX_IDL
+//! @param max_steps give up after
+//! @param blank_steps stall is ignored until
+//! @param sg_limit StallGuard reading below is a stall
+//! @param fast
+//!  * true bursts of 4 steps
+//!  * false single steps
+//! @return steps done until stall, at least max_steps if there was none
+static uint16_t approach_stall(uint8_t axis, uint16_t max_steps, uint16_t blank_steps, uint16_t sg_limit, bool fast)
+{
+    const uint8_t burst = fast ? 4 : 1;
+    const uint16_t start = step_engine_steps(axis);
+    uint16_t steps = 0;
+    tmc2130_job_t sg;
+    s_approaching = true;
+    while (steps < max_steps)
+    {
+        step_engine_wait_queued(1);
+        const bool check = (steps > blank_steps);
+        if (check) tmc2130_request_sg(&sg, axis);
+        step_engine_queue(1 << axis, burst, axis_ramp_period(axis, 0));
+        if (check && (tmc2130_wait_sg(&sg) < sg_limit))
+        {
+            step_engine_stop();
+            break;
+        }
+        steps += burst;
+    }
+    step_engine_wait();
+    s_approaching = false;
+    return step_engine_steps(axis) - start;
+}
+
+//! @brief Is homing or probe approaching end stop, reading StallGuard?
+bool is_approaching_stall()
+{
+    return s_approaching;
+}
+
+//! @brief Home axis by StallGuard
 //!
-//! @param toLastFilament
-//!   - true
-//! Move idler to previously loaded filament and disengage. Returns true.
-//! Does nothing if last filament used is not known and returns false.
-//!   - false (default)
-//! Move idler to filament 0 and disengage. Returns true.
+//! Fast approach finds the end stop, after backing off a slow approach
+//! finds it precisely. Result is confident if the slow approach stalled
+//! where the fast one did.
+//! @param axis AX_SEL or AX_IDL
+//! @param max_steps travel limit of fast approach
+//! @param blank_steps stall is ignored until
+//! @param sg_limit StallGuard reading below is a stall
+//! @param back_off steps
+static HomingResult home_axis(uint8_t axis, uint16_t max_steps, uint16_t blank_steps, uint16_t sg_limit, uint16_t back_off)
+{
+    if (axis == AX_SEL) set_selector_direction(1);
+    else set_idler_direction(1);
+    if (approach_stall(axis, max_steps, blank_steps, sg_limit, true) >= max_steps) return HomingResult::Failed;
+
+    if (axis == AX_SEL) move(0, -back_off, 0);
+    else move(-back_off, 0, 0);
+    delay(50);
+
+    if (axis == AX_SEL) set_selector_direction(1);
+    else set_idler_direction(1);
+    const uint16_t tolerance = back_off / 8;
+    const uint16_t steps = approach_stall(axis, back_off + tolerance + 1, back_off / 2, sg_limit, false);
+    if (steps > back_off + tolerance) return HomingResult::Failed;
+    return (steps + tolerance >= back_off) ? HomingResult::Confident : HomingResult::Ambiguous;
+}
+
+//! @brief home idler
 //!
-//! @retval true Succeeded
-//! @retval false Failed
-bool home_idler()
+//! Repeats homing while result is not confident, up to three times.
+//! Idler is left parked at filament 0. If the end stop was not found at all,
+//! it is a drive error and unrecoverable.
+//! @return result of last homing pass
+HomingResult home_idler()
 {
+    PhaseMark mark(Phase::HomeIdler);
 #ifdef SSD_DISPLAY
   display_message(MSG_HOMING);
 #endif
-	int _c = 0;
-	int _l = 0;
-
 	tmc2130_init(HOMING_MODE);
 
-
-	for (int c = 3; c > 0; c--)  // not really functional, let's do it rather more times to be sure
+	for (uint8_t pass = 0; pass < 3; ++pass)
 	{
-    int i;
-    move(-10, 0, 0); // move a bit in opposite direction
-		delay(500);
-		for (i = 0; i < 3000; i++)
-		{
-			move(1, 0, 0);
-			uint16_t sg = tmc2130_read_sg(AX_IDL);
-      if ((i > ((c==3)?IDLER_STEPS:16)) && (sg < 16)) break;
-
-			_c++;
-			if (i == 1000) { _l++; }
-			if (_c > 100) { shr16_set_led(1 << 2 * _l); };
-			if (_c > 200) { shr16_set_led(0x000); _c = 0; };
-		}
-    if (i >= 2900)
-    {
-      break;
-    }
+		if (pass) event_retry(Phase::HomeIdler, pass);
+		shr16_set_led(1 << 2 * pass);
+		move(-10, 0, 0); // move a bit in opposite direction
+		// travel limit is less than a revolution of the idler (3200 steps)
+		s_homing_result[AX_IDL] = home_axis(AX_IDL, 3000, (pass == 0) ? IDLER_STEPS : 16, 16, 80);
+		if (s_homing_result[AX_IDL] == HomingResult::Confident) break;
+	}
+	shr16_set_led(0x000);
+	if (s_homing_result[AX_IDL] == HomingResult::Failed)
+	{
+		drive_error();
+		unrecoverable_error();
 	}
 
 	move(IDLER_STEPS_AFTER_HOMING, 0, 0); // move to initial position
@@ -130,11 +211,17 @@ bool home_idler()
 
 	park_idler(false);
 
-	return true;
+	return s_homing_result[AX_IDL];
 }
 
-bool home_selector()
+//! @brief home selector
+//!
+//! Repeats homing while result is not confident, up to seven times.
+//! If the end stop was not found at all, it is a drive error and unrecoverable.
+//! @return result of last homing pass
+HomingResult home_selector()
 {
+    PhaseMark mark(Phase::HomeSelector);
 #ifdef SSD_DISPLAY
     display_message(MSG_HOMING);
 #endif
@@ -144,24 +231,19 @@ bool home_selector()
 
     tmc2130_init(HOMING_MODE);
 
-	int _c = 0;
-	int _l = 2;
-
-	for (int c = 7; c > 0; c--)   // not really functional, let's do it rather more times to be sure
+	for (uint8_t pass = 0; pass < 7; ++pass)
 	{
-		if (c < 7) { move(0, c * -18, 0); }
-		delay(50);
-		for (int i = 0; i < 4000; i++)
-		{
-			move(0, 1, 0);
-			uint16_t sg = tmc2130_read_sg(AX_SEL);
-			if ((i > 16) && (sg < 5))	break;
-
-			_c++;
-			if (i == 3000) { _l++; }
-			if (_c > 100) { shr16_set_led(1 << 2 * _l); };
-			if (_c > 200) { shr16_set_led(0x000); _c = 0; };
-		}
+		if (pass) event_retry(Phase::HomeSelector, pass);
+		shr16_set_led(1 << 2 * (2 + pass % 3));
+		// filament 0 is the farthest position from the end stop, allow one more slot
+		s_homing_result[AX_SEL] = home_axis(AX_SEL, SELECTOR_STEPS - SELECTOR_STEPS_AFTER_HOMING, 16, 5, 50);
+		if (s_homing_result[AX_SEL] == HomingResult::Confident) break;
+	}
+	shr16_set_led(0x000);
+	if (s_homing_result[AX_SEL] == HomingResult::Failed)
+	{
+		drive_error();
+		unrecoverable_error();
 	}
 
 	move(0, SELECTOR_STEPS_AFTER_HOMING, 0); // move to initial position
@@ -170,7 +252,80 @@ bool home_selector()
 
 	delay(500);
 
-	return true;
+	return s_homing_result[AX_SEL];
+}
+
+//! @brief Result of last homing of an axis
+//! @param axis AX_SEL or AX_IDL
+HomingResult get_homing_result(uint8_t axis)
+{
+    return s_homing_result[axis];
+}
+
+//! @brief Check axis moves freely for a few steps towards end stop and back
+//! @param axis AX_SEL or AX_IDL
+//! @param sg_limit StallGuard reading below is a stall
+static bool probe_axis(uint8_t axis, uint16_t sg_limit)
+{
+    const uint16_t probe_steps = 48;
+    if (axis == AX_SEL) set_selector_direction(1);
+    else set_idler_direction(1);
+    if (approach_stall(axis, probe_steps, 16, sg_limit, false) < probe_steps) return false;
+    if (axis == AX_SEL) move(0, -probe_steps, 0);
+    else move(-probe_steps, 0, 0);
+    return true;
+}
+
+//! @brief Store parked idler and selector position once they stood still for persist_delay
+//!
+//! Stored record is invalidated by next move of idler or selector.
+//! @param idler idler
+//! @param selector selector
+void persist_position(uint8_t idler, uint8_t selector)
+{
+    if (s_position_persisted || !isIdlerParked || (millis() - s_last_move < persist_delay)) return;
+    HomedPosition::Position position = {idler, selector, tmc2130_read_mscnt(AX_IDL), tmc2130_read_mscnt(AX_SEL)};
+    HomedPosition::set(position);
+    s_position_persisted = true; // do not retry failed write in every loop
+}
+
+//! @brief Note drivers which reported reset or error at boot
+//!
+//! Microstep counter of a reset driver starts from 0 again and may match the stored
+//! one by chance, restore_position() refuses to restore if idler or selector driver was reset.
+//! @param axes tmc2130_read_gstat() result of the first read after boot
+void set_boot_drive_reset(uint8_t axes)
+{
+    s_drive_reset = axes & ((1 << AX_IDL) | (1 << AX_SEL));
+}
+
+//! @brief Restore idler and selector position stored before reset
+//!
+//! Stored position is used if it was not invalidated, idler and selector drivers
+//! did not report reset at boot, see set_boot_drive_reset(), their microstep counters
+//! did not change and both axes pass a short StallGuard probe. Selector is probed
+//! only if there is no filament in it.
+//! @param [out] idler idler
+//! @param [out] selector selector
+//! @retval true restored, idler is parked
+//! @retval false homing needed
+bool restore_position(uint8_t &idler, uint8_t &selector)
+{
+    HomedPosition::Position position;
+    if (s_drive_reset || !HomedPosition::get(position)) return false;
+    if ((tmc2130_read_mscnt(AX_IDL) != position.idlerMscnt) || (tmc2130_read_mscnt(AX_SEL) != position.selectorMscnt)) return false;
+
+    tmc2130_init(HOMING_MODE);
+    // selector is not probed while FINDA senses filament
+    const bool free = probe_axis(AX_IDL, 16) && (digitalRead(A1) || probe_axis(AX_SEL, 5));
+    tmc2130_init(tmc2130_mode);
+    if (!free) return false;
+
+    idler = position.idler;
+    selector = position.selector;
+    isIdlerParked = true;
+    s_position_persisted = true;
+    return true;
 }
 
 //! @brief Home both idler and selector if already not done
@@ -189,34 +344,86 @@ void home()
 }
  
 
+//! @brief Scale from steps of an axis to ticks of the line
+static uint16_t line_scale(uint16_t value, uint16_t steps, uint16_t ticks)
+{
+    return (steps == ticks) ? value : static_cast<uint16_t>(static_cast<uint32_t>(value) * steps / ticks);
+}
+
+//! @brief Tick period of a line at ramp index
+//!
+//! Each axis is limited by its own ramp at the number of its steps done,
+//! an axis with fewer steps than ticks allows a proportionally shorter tick.
+//! @param steps steps of each axis
+//! @param ticks ticks of the line
+//! @param ramp ticks from the nearer end of the line
+static uint16_t move_period(const uint16_t steps[3], uint16_t ticks, uint16_t ramp)
+{
+    uint16_t period = 0;
+    for (uint8_t axis = AX_SEL; axis <= AX_IDL; ++axis)
+    {
+        if (!steps[axis]) continue;
+        const uint16_t axis_period = line_scale(axis_ramp_period(axis, line_scale(ramp, steps[axis], ticks)), steps[axis], ticks);
+        if (axis_period > period) period = axis_period;
+    }
+    if (steps[AX_PUL])
+    {
+        const uint16_t pulley_period = line_scale(PULLEY_DELAY_PRIME, steps[AX_PUL], ticks);
+        if (pulley_period > period) period = pulley_period;
+    }
+    return period ? period : 1;
+}
+
+//! @brief Ticks of a line to reach cruise speed of all axes
+static uint16_t move_ramp_ticks(const uint16_t steps[3], uint16_t ticks)
+{
+    uint16_t ramp_ticks = 0;
+    for (uint8_t axis = AX_SEL; axis <= AX_IDL; ++axis)
+    {
+        if (!steps[axis]) continue;
+        const uint32_t axis_ticks = (static_cast<uint32_t>(axis_ramp_steps(axis)) * ticks + steps[axis] - 1) / steps[axis];
+        if (axis_ticks > ramp_ticks) ramp_ticks = (axis_ticks < ticks) ? axis_ticks : ticks;
+    }
+    return ramp_ticks;
+}
+
+//! @brief Move axes simultaneously, return when done
+//!
+//! Axes are interpolated by the step engine, all of them start and finish
+//! together. The line accelerates, cruises and decelerates so that neither
+//! selector nor idler exceed the rate and acceleration of their own ramp.
+//! Single steps are done at start rate. Pulley is moved at PULLEY_DELAY_PRIME.
 void move(int _idler, int _selector, int _pulley)
 {
-  int _acc = (abs(_idler)>1 || abs(_selector)>1) ? 128 : 0;
-  int delay = (abs(_pulley)>1) ? PULLEY_DELAY_PRIME : 1152;
+	uint16_t steps[3];
+
+	step_engine_wait();
+	if ((_idler || _selector) && s_position_persisted)
+	{
+		HomedPosition::invalidate();
+		s_position_persisted = false;
+	}
 
 	// gets steps to be done and set direction
-	_idler = set_idler_direction(_idler); 
-	_selector = set_selector_direction(_selector);
-	_pulley = set_pulley_direction(_pulley);
-	
-	do
+	steps[AX_IDL] = set_idler_direction(_idler);
+	steps[AX_SEL] = set_selector_direction(_selector);
+	steps[AX_PUL] = set_pulley_direction(_pulley);
+	step_engine_line(steps);
+
+	uint16_t ticks = 0;
+	for (uint8_t axis = 0; axis < 3; ++axis) if (steps[axis] > ticks) ticks = steps[axis];
+	const uint16_t ramp_ticks = move_ramp_ticks(steps, ticks);
+
+	for (uint16_t tick = 0; tick < ticks;)
 	{
-		if (_idler > 0) { idler_step_pin_set(); }
-		if (_selector > 0) { selector_step_pin_set();}
-		if (_pulley > 0) { pulley_step_pin_set(); }
-		asm("nop");
-		if (_idler > 0) { idler_step_pin_reset(); _idler--; }
-		if (_selector > 0) { selector_step_pin_reset(); _selector--; }
-		if (_pulley > 0) { pulley_step_pin_reset(); _pulley--;  }
-		asm("nop");
-       
-    delayMicroseconds(delay);
-    //if (delay > 1000) { delay -= 10; }
-    //if (delay < 2000  && (_selector < _acc || _idler < _acc)) { delay += 10; }
-
-    if (_acc > 0) { delayMicroseconds(_acc*10); _acc -= 1; }; // super pseudo acceleration control
-
-	} while (_selector != 0 || _idler != 0 || _pulley != 0);
+		const uint16_t ramp = min(tick, static_cast<uint16_t>(ticks - 1 - tick));
+		uint16_t count = 1;
+		if (ramp >= ramp_ticks) count = ticks - tick - ramp_ticks; // cruise until deceleration
+		step_engine_queue_line(count, move_period(steps, ticks, ramp));
+		tick += count;
+	}
+	step_engine_wait();
+	s_last_move = millis();
 }
 
 
@@ -306,6 +513,7 @@ int set_pulley_direction(int _steps)
 
 void set_pulley_dir_push()
 {
+  step_engine_wait();
 #ifdef REVERSE_PULLEY
   shr16_set_dir(shr16_get_dir() | 1);
 #else  
@@ -314,6 +522,7 @@ void set_pulley_dir_push()
 }
 void set_pulley_dir_pull()
 {
+  step_engine_wait();
 #ifdef REVERSE_PULLEY
   shr16_set_dir(shr16_get_dir() & ~1);
 #else  
@@ -9,17 +9,33 @@
 
 extern int8_t filament_type[EXTRUDERS];
 
+//! @brief Confidence of StallGuard homing
+enum class HomingResult : uint8_t
+{
+    None,       //!< not homed yet
+    Failed,     //!< no stall within travel
+    Ambiguous,  //!< precise approach did not stall where the fast one did
+    Confident,  //!< precise approach stalled where the fast one did
+};
+
 void home();
-bool home_idler();
+HomingResult home_idler();
+HomingResult home_selector();
+HomingResult get_homing_result(uint8_t axis);
+bool is_approaching_stall();
+void persist_position(uint8_t idler, uint8_t selector);
+void set_boot_drive_reset(uint8_t axes);
+bool restore_position(uint8_t &idler, uint8_t &selector);
 
 int get_pulley_steps(float mm);
-int get_pulley_acceleration_steps(int16_t delay_start, int16_t delay_end);
 int get_idler_steps(int current_filament, int next_filament);
 int get_selector_steps(int current_filament, int next_filament);
+uint16_t get_steps_along_pulley(uint8_t axis, uint16_t pulley_steps);
 
 void park_idler(bool _unpark);
 
-void do_pulley_step();
+void do_pulley_step(uint16_t period);
+void do_pulley_steps(uint16_t steps, uint16_t period);
 void set_pulley_dir_pull();
 void set_pulley_dir_push();
 void move(int _idler, int _selector, int _pulley);
@@ -0,0 +1,103 @@
+//! @file
+//! @brief Periodic samples streamed to USB console for tuning
+
+#include "telemetry.h"
+#include <Arduino.h>
+#include <stdio.h>
+#include "main.h"
+#include "config.h"
+#include "uart.h"
+#include "tmc2130.h"
+#include "shr16.h"
+#include "mmctl.h"
+#include "step_engine.h"
+#include "stepper.h"
+
+namespace
+{
+
+const uint8_t csv_max = 64;        //!< longest CSV line
+const uint8_t sample_size = 17;    //!< binary payload
+const uint8_t frame_overhead = 5;  //!< start, length, sequence, opcode, CRC
+
+uint16_t s_period = 0;  //!< [ms], 0 stopped
+bool s_binary = false;
+uint32_t s_next;        //!< millis() of next sample
+uint32_t s_last_poll;   //!< micros() of previous telemetry_poll()
+uint16_t s_latency;     //!< longest time between telemetry_poll() calls since previous sample [us]
+uint16_t s_sample;      //!< number of next sample
+
+uint8_t* put16(uint8_t* p, uint16_t value)
+{
+    *p++ = value;
+    *p++ = value >> 8;
+    return p;
+}
+
+} // unnamed namespace
+
+//! @param period [ms], 0 stops streaming
+//! @param binary send binary protocol frames, CSV lines otherwise
+void telemetry_start(uint16_t period, bool binary)
+{
+    s_period = period;
+    s_binary = binary;
+    s_next = millis();
+    s_last_poll = micros();
+    s_latency = 0;
+    s_sample = 0;
+}
+
+//! @brief Send sample if it is due
+//!
+//! Called from loop() and yield(). Samples missed while they were not called
+//! are skipped, not sent late.
+void telemetry_poll()
+{
+    static bool busy = false;
+    if (!s_period || busy) return;
+    const uint32_t now = micros();
+    const uint32_t gap = now - s_last_poll;
+    s_last_poll = now;
+    if (gap > s_latency) s_latency = min(gap, static_cast<uint32_t>(UINT16_MAX));
+    const uint32_t time = millis();
+    if (static_cast<int32_t>(time - s_next) < 0) return;
+    s_next += s_period;
+    if (static_cast<int32_t>(time - s_next) >= 0) s_next = time + s_period;
+    const uint16_t sample = s_sample++;
+    if (Serial.availableForWrite() < (s_binary ? (sample_size + frame_overhead) : csv_max)) return;
+    // DRV_STATUS is read synchronously, it must not hold up queued register access or homing
+    if (tmc2130_jobs_pending() || is_approaching_stall()) return;
+
+    busy = true;
+    uint32_t drv_status[3];
+    tmc2130_read_drv_status_all(drv_status);
+    uint16_t sg[3];
+    for (uint8_t axis = 0; axis < 3; ++axis) sg[axis] = drv_status[axis] & 0x3ff;
+    const uint8_t finda = digitalRead(A1);
+    const uint16_t steps = step_engine_steps(AX_PUL);
+#ifdef REVERSE_PULLEY
+    const uint8_t dir = shr16_get_dir() & 1;
+#else
+    const uint8_t dir = !(shr16_get_dir() & 1);
+#endif
+    if (s_binary)
+    {
+        uint8_t payload[sample_size];
+        uint8_t* p = put16(put16(payload, time), time >> 16);
+        for (uint8_t axis = 0; axis < 3; ++axis) p = put16(p, sg[axis]);
+        *p++ = finda;
+        p = put16(p, steps);
+        *p++ = dir;
+        *p++ = active_extruder;
+        put16(p, s_latency);
+        send_frame(uart0io, sample, 'Q', payload, sample_size);
+    }
+    else
+    {
+        fprintf_P(uart0io, PSTR("%u,%lu,%u,%u,%u,%d,%u,%d,%d,%u\n"), sample, static_cast<unsigned long>(time),
+            sg[AX_PUL], sg[AX_SEL], sg[AX_IDL], finda, steps, dir, active_extruder, s_latency);
+    }
+    s_latency = 0;
+    busy = false;
+}
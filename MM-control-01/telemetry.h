@@ -0,0 +1,34 @@
+//! @file
+//! @brief Periodic samples streamed to USB console for tuning
+//!
+//! Q\<period ms\> starts streaming a sample every period, Q\<period ms\> 1 streams
+//! them as binary protocol frames, Q0 stops. Each sample holds:
+//!
+//! Field       | Meaning
+//! ----------- | ------------------------------------------------------------
+//! sample      | sample number, gap shows samples dropped as USB had no room or StallGuard homing ran
+//! time        | millis()
+//! sg          | StallGuard of pulley, selector and idler, tmc2130_read_drv_status_all()
+//! finda       | FINDA state
+//! steps       | pulley steps, step_engine_steps(AX_PUL), wraps
+//! dir         | pulley direction, 1 push
+//! extruder    | active_extruder
+//! latency     | longest time loop() or yield() was not called since previous sample [us]
+//!
+//! CSV line is sample,time,sg pulley,sg selector,sg idler,finda,steps,dir,extruder,latency.
+//! Binary frame has sequence sample & 0xff, opcode 'Q' and payload of the same fields
+//! in the same order, little endian: time uint32, sg 3x uint16, finda uint8, steps uint16,
+//! dir uint8, extruder uint8, latency uint16.
+//!
+//! A sample is sent only if USB CDC can take it without waiting, so the command
+//! handling is never slowed down by a USB host which does not read.
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+void telemetry_start(uint16_t period, bool binary);
+void telemetry_poll();
+
+#endif //TELEMETRY_H_
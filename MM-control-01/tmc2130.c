@@ -2,11 +2,15 @@
 
 #include "tmc2130.h"
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "spi.h"
 #include <stdio.h>
 #include <avr/pgmspace.h>
 #include "pins.h"
 #include "config.h"
+#include "shr16.h"
+#include <Arduino.h>
 
 #define TMC2130_CS_0 //signal d5  - PC6
 #define TMC2130_CS_1 //signal d6  - PD7
@@ -49,16 +53,106 @@
 #define TMC2130_REG_ENCM_CTRL  0x72 // 2 bits
 #define TMC2130_REG_LOST_STEPS 0x73 // 20 bits
 
+//register bits used by tmc2130_check_axis()
+#define TMC2130_GCONF_EN_PWM_MODE       0x00000004
+#define TMC2130_GCONF_SMALL_HYSTERESIS  0x00004000
+#define TMC2130_IOIN_DRV_ENN            0x00000010
+#define TMC2130_DRV_STATUS_S2G          0x18000000 // s2ga, s2gb
+#define TMC2130_DRV_STATUS_OL           0x60000000 // ola, olb
+
 
 #define tmc2130_rd(axis, addr, rval) tmc2130_rx(axis, addr, rval)
 #define tmc2130_wr(axis, addr, wval) tmc2130_tx(axis, addr | 0x80, wval)
 
 static void tmc2130_tx(uint8_t axis, uint8_t addr, uint32_t wval);
 uint8_t tmc2130_rx(uint8_t axis, uint8_t addr, uint32_t* rval);
+uint8_t tmc2130_rd_batch(uint8_t axis, const uint8_t* addr, uint32_t* rval, uint8_t count);
+static void tmc2130_rd_all(uint8_t addr, uint32_t rval[3]);
 uint8_t tmc2130_usteps2mres(uint16_t usteps);
 static void tmc2130_cs_low(uint8_t axis);
 static void tmc2130_cs_high(uint8_t axis);
 
+//! @name Shadow copy of written registers
+//!
+//! Write of the value a register already holds is skipped, so repeated
+//! tmc2130_init() and tmc2130_init_axis() calls send only changed registers.
+//! Copy of an axis is dropped when its driver reports reset or error, see
+//! tmc2130_shadow_invalidate().
+//! @{
+#define TMC2130_SHADOW_REGS 8
+static uint32_t tmc2130_shadow[3][TMC2130_SHADOW_REGS];
+static uint8_t tmc2130_shadow_valid[3]; // bit flag for each shadow register
+static uint16_t tmc2130_writes_sent = 0;
+static uint16_t tmc2130_writes_skipped = 0;
+//! @}
+
+//! @brief Shadow register index of register address, -1 not shadowed
+static int8_t tmc2130_shadow_index(uint8_t addr)
+{
+	switch (addr)
+	{
+	case TMC2130_REG_GCONF: return 0;
+	case TMC2130_REG_IHOLD_IRUN: return 1;
+	case TMC2130_REG_TPOWERDOWN: return 2;
+	case TMC2130_REG_TPWMTHRS: return 3;
+	case TMC2130_REG_TCOOLTHRS: return 4;
+	case TMC2130_REG_CHOPCONF: return 5;
+	case TMC2130_REG_COOLCONF: return 6;
+	case TMC2130_REG_PWMCONF: return 7;
+	}
+	return -1;
+}
+
+//! @brief Driver lost its registers, next write of each of them is sent
+static void tmc2130_shadow_invalidate(uint8_t axis)
+{
+	tmc2130_shadow_valid[axis] = 0;
+}
+
+//! @brief Send next write of register even if it holds the value
+//!
+//! Skipped write sends no datagram, so reset flag in SPI status, e.g. after
+//! brown-out of the driver, would be seen only after the skip. Status of the
+//! forced write drops the shadow copy of a reset axis before its other writes.
+static void tmc2130_shadow_force(uint8_t axis, uint8_t addr)
+{
+	cli(); // written by SPI interrupt too
+	tmc2130_shadow_valid[axis] &= ~(1 << tmc2130_shadow_index(addr));
+	sei();
+}
+
+//! @brief Write of value the register already holds
+static uint8_t tmc2130_shadow_match(uint8_t axis, uint8_t addr, uint32_t wval)
+{
+	const int8_t shadow = tmc2130_shadow_index(addr & 0x7f);
+	return (shadow >= 0) && (tmc2130_shadow_valid[axis] & (1 << shadow)) && (tmc2130_shadow[axis][shadow] == wval);
+}
+
+static void tmc2130_shadow_store(uint8_t axis, uint8_t addr, uint32_t wval)
+{
+	const int8_t shadow = tmc2130_shadow_index(addr & 0x7f);
+	if (shadow < 0) return;
+	tmc2130_shadow[axis][shadow] = wval;
+	tmc2130_shadow_valid[axis] |= (1 << shadow);
+}
+
+static void tmc2130_count(uint16_t* counter)
+{
+	if (*counter < UINT16_MAX) ++*counter;
+}
+
+//! @brief Register writes sent over SPI since reset, saturates at 65535
+uint16_t tmc2130_get_writes_sent(void)
+{
+	return tmc2130_writes_sent;
+}
+
+//! @brief Register writes skipped by shadow copy since reset, saturates at 65535
+uint16_t tmc2130_get_writes_skipped(void)
+{
+	return tmc2130_writes_skipped;
+}
+
 int8_t tmc2130_wr_CHOPCONF(uint8_t axis, uint8_t toff, uint8_t hstrt, uint8_t hend, uint8_t fd3, uint8_t disfdcc, uint8_t rndtf, uint8_t chm, uint8_t tbl, uint8_t vsense, uint8_t vhighfs, uint8_t vhighchm, uint8_t sync, uint8_t mres, uint8_t intpol, uint8_t dedge, uint8_t diss2g)
 {
 	uint32_t val = 0;
@@ -104,6 +198,28 @@ void tmc2130_wr_TPWMTHRS(uint8_t axis, uint32_t val32)
 }
 
 
+inline uint8_t __tpowerdown(uint8_t axis)
+{
+	switch (axis)
+	{
+	case AX_PUL: return TMC2130_TPOWERDOWN_0;
+	case AX_SEL: return TMC2130_TPOWERDOWN_1;
+	case AX_IDL: return TMC2130_TPOWERDOWN_2;
+	}
+	return 0;
+}
+
+inline uint8_t __iholddelay(uint8_t axis)
+{
+	switch (axis)
+	{
+	case AX_PUL: return TMC2130_IHOLDDELAY_0;
+	case AX_SEL: return TMC2130_IHOLDDELAY_1;
+	case AX_IDL: return TMC2130_IHOLDDELAY_2;
+	}
+	return 15;
+}
+
 int8_t tmc2130_setup_chopper(uint8_t axis, uint8_t mres, uint8_t current_h, uint8_t current_r)
 {
 	uint8_t intpol = 1;
@@ -117,12 +233,12 @@ int8_t tmc2130_setup_chopper(uint8_t axis, uint8_t mres, uint8_t current_h, uint
 	if (current_r <= 31)
 	{
 		if (tmc2130_wr_CHOPCONF(axis, toff, hstrt, hend, fd3, 0, rndtf, chm, tbl, 1, 0, 0, 0, mres, intpol, 0, 0)) return -1;
-		tmc2130_wr(axis, TMC2130_REG_IHOLD_IRUN, 0x000f0000 | ((current_r & 0x1f) << 8) | (current_h & 0x1f));
+		tmc2130_wr(axis, TMC2130_REG_IHOLD_IRUN, ((uint32_t)__iholddelay(axis) << 16) | ((current_r & 0x1f) << 8) | (current_h & 0x1f));
 	}
 	else
 	{
 		if (tmc2130_wr_CHOPCONF(axis, toff, hstrt, hend, fd3, 0, 0, 0, tbl, 0, 0, 0, 0, mres, intpol, 0, 0)) return -1;
-		tmc2130_wr(axis, TMC2130_REG_IHOLD_IRUN, 0x000f0000 | (((current_r >> 1) & 0x1f) << 8) | ((current_h >> 1) & 0x1f));
+		tmc2130_wr(axis, TMC2130_REG_IHOLD_IRUN, ((uint32_t)__iholddelay(axis) << 16) | (((current_r >> 1) & 0x1f) << 8) | ((current_h >> 1) & 0x1f));
 	}
 	return 0;
 }
@@ -194,43 +310,140 @@ int8_t tmc2130_init_axis(uint8_t axis, uint8_t mode)
 	return ret;
 }
 
-void tmc2130_disable_axis(uint8_t axis, uint8_t mode)
+//! @brief Switch on axis driver outputs by its ENA line
+//!
+//! Driver configuration is resident, this is a single shift register write.
+//! tmc2130_init_axis() and tmc2130_init_axis_current_normal() / _stealth() enable the axis too.
+void tmc2130_enable_axis(uint8_t axis)
 {
-	//temporary solution, use enable pin instead
-	if (mode == STEALTH_MODE) tmc2130_init_axis_current_stealth(axis, 0, 0);
-	else tmc2130_init_axis_current_normal(axis, 0, 0);
+	shr16_set_ena(shr16_get_ena() | (1 << axis));
+}
+
+//! @brief Switch off axis driver outputs by its ENA line, motor runs free
+//!
+//! Driver configuration stays resident, so enabling again needs no SPI traffic.
+void tmc2130_disable_axis(uint8_t axis)
+{
+	shr16_set_ena(shr16_get_ena() & ~(1 << axis));
 }
 
 int8_t tmc2130_init_axis_current_stealth(uint8_t axis, uint8_t current_h, uint8_t current_r)
 {
 	//stealth mode
+	tmc2130_shadow_force(axis, TMC2130_REG_CHOPCONF);
 	if (tmc2130_setup_chopper(axis, (uint32_t)__res(axis), current_h, current_r)) return -1;
-	tmc2130_wr(axis, TMC2130_REG_TPOWERDOWN, 0x00000000);
+	tmc2130_wr(axis, TMC2130_REG_TPOWERDOWN, __tpowerdown(axis));
 	tmc2130_wr(axis, TMC2130_REG_COOLCONF, (((uint32_t)TMC2130_SG_THR) << 16));
 	tmc2130_wr(axis, TMC2130_REG_TCOOLTHRS, 0);
 	tmc2130_wr(axis, TMC2130_REG_GCONF, 0x00000004);
 	tmc2130_wr_PWMCONF(axis, 210, 6, 2, 1, 0, 0);
 	tmc2130_wr_TPWMTHRS(axis, 200);
+	tmc2130_enable_axis(axis);
 	return 0;
 }
 
 int8_t tmc2130_init_axis_current_normal(uint8_t axis, uint8_t current_h, uint8_t current_r)
 {
 	//normal mode
+	tmc2130_shadow_force(axis, TMC2130_REG_CHOPCONF);
 	if (tmc2130_setup_chopper(axis, (uint32_t)__res(axis), current_h, current_r)) return -1;
-	tmc2130_wr(axis, TMC2130_REG_TPOWERDOWN, 0x00000000);
+	tmc2130_wr(axis, TMC2130_REG_TPOWERDOWN, __tpowerdown(axis));
 	tmc2130_wr(axis, TMC2130_REG_COOLCONF, (((uint32_t)__sg_thr(axis)) << 16));
 	tmc2130_wr(axis, TMC2130_REG_TCOOLTHRS, __tcoolthrs(axis));
 	tmc2130_wr(axis, TMC2130_REG_GCONF, 0x00003180);
+	tmc2130_enable_axis(axis);
 	return 0;
 }
 
-#ifdef _DIAG
-uint8_t tmc2130_check_axis(uint8_t axis)
+//! @brief Single step pulse, DIR and ENA are set by shift register
+static void tmc2130_step(uint8_t axis)
+{
+	switch (axis)
+	{
+	case AX_PUL: pulley_step_pin_set(); asm("nop"); pulley_step_pin_reset(); break;
+	case AX_SEL: selector_step_pin_set(); asm("nop"); selector_step_pin_reset(); break;
+	case AX_IDL: idler_step_pin_set(); asm("nop"); idler_step_pin_reset(); break;
+	}
+}
+
+//! @brief Driver self-test
+//!
+//! Checks run in this order, each one is timed:
+//!  * SPI
+//!    * GCONF is written with small_hysteresis bit flipped and restored, both values have to read back.
+//!      Other checks are skipped if it fails.
+//!  * STP, DIR
+//!    * One microstep forth and back, MSCNT has to change and return.
+//!  * MSC, MOC
+//!    * DRV_STATUS short to ground (s2ga, s2gb) and open load (ola, olb) flags.
+//!      Open load is checked in spreadCycle only, read right after the step it is just a hint.
+//!  * ENA
+//!    * ENA line switched off and on, IOIN DRV_ENN has to follow.
+//!
+//! Axis has to stand still, motor moves by one microstep and returns.
+//! Enable state, DIR and GCONF are restored.
+//! @param axis axis
+//! @param time_us [out] duration of checks, indexed by TMC2130_CHECK_TIME_SPI to TMC2130_CHECK_TIME_ENA
+//! @return TMC2130_CHECK_* flags of passed checks, TMC2130_CHECK_OK if all passed
+uint8_t tmc2130_check_axis(uint8_t axis, uint16_t time_us[TMC2130_CHECK_TIMES])
 {
-	return 0x3f;
+	uint8_t check = 0;
+	uint32_t val = 0;
+	for (uint8_t i = 0; i < TMC2130_CHECK_TIMES; ++i) time_us[i] = 0;
+
+	uint32_t start = micros();
+	uint32_t gconf = 0;
+	tmc2130_rd(axis, TMC2130_REG_GCONF, &gconf);
+	tmc2130_wr(axis, TMC2130_REG_GCONF, gconf ^ TMC2130_GCONF_SMALL_HYSTERESIS);
+	tmc2130_rd(axis, TMC2130_REG_GCONF, &val);
+	const uint8_t echo = (val == (gconf ^ TMC2130_GCONF_SMALL_HYSTERESIS));
+	tmc2130_wr(axis, TMC2130_REG_GCONF, gconf);
+	// restored GCONF and MSCNT before the step are read in one batch
+	const uint8_t batch[2] = {TMC2130_REG_GCONF, TMC2130_REG_MSCNT};
+	uint32_t batch_val[2];
+	tmc2130_rd_batch(axis, batch, batch_val, 2);
+	if (echo && (batch_val[0] == gconf)) check |= TMC2130_CHECK_SPI;
+	time_us[TMC2130_CHECK_TIME_SPI] = micros() - start;
+	if (!(check & TMC2130_CHECK_SPI)) return check;
+
+	const uint8_t ena = shr16_get_ena();
+	const uint8_t dir = shr16_get_dir();
+	tmc2130_enable_axis(axis);
+
+	start = micros();
+	uint32_t mscnt[3];
+	mscnt[0] = batch_val[1];
+	tmc2130_step(axis);
+	tmc2130_rd(axis, TMC2130_REG_MSCNT, &mscnt[1]);
+	shr16_set_dir(dir ^ (1 << axis));
+	tmc2130_step(axis);
+	tmc2130_rd(axis, TMC2130_REG_MSCNT, &mscnt[2]);
+	shr16_set_dir(dir);
+	if (mscnt[1] != mscnt[0])
+	{
+		check |= TMC2130_CHECK_STP;
+		if (mscnt[2] == mscnt[0]) check |= TMC2130_CHECK_DIR;
+	}
+	time_us[TMC2130_CHECK_TIME_PINS] = micros() - start;
+
+	start = micros();
+	tmc2130_rd(axis, TMC2130_REG_DRV_STATUS, &val);
+	if (!(val & TMC2130_DRV_STATUS_S2G)) check |= TMC2130_CHECK_MSC;
+	if ((gconf & TMC2130_GCONF_EN_PWM_MODE) || !(val & TMC2130_DRV_STATUS_OL)) check |= TMC2130_CHECK_MOC;
+	time_us[TMC2130_CHECK_TIME_LOAD] = micros() - start;
+
+	start = micros();
+	tmc2130_disable_axis(axis);
+	tmc2130_rd(axis, TMC2130_REG_IOIN, &val);
+	const uint8_t disabled = (val & TMC2130_IOIN_DRV_ENN) != 0;
+	tmc2130_enable_axis(axis);
+	tmc2130_rd(axis, TMC2130_REG_IOIN, &val);
+	if (disabled && !(val & TMC2130_IOIN_DRV_ENN)) check |= TMC2130_CHECK_ENA;
+	time_us[TMC2130_CHECK_TIME_ENA] = micros() - start;
+
+	shr16_set_ena(ena);
+	return check;
 }
-#endif
 
 
 
@@ -270,6 +483,13 @@ uint16_t tmc2130_read_sg(uint8_t axis)
 	return (val32 & 0x3ff);
 }
 
+uint16_t tmc2130_read_mscnt(uint8_t axis)
+{
+	uint32_t val32 = 0;
+	tmc2130_rd(axis, TMC2130_REG_MSCNT, &val32);
+	return (val32 & 0x3ff);
+}
+
 
 static void tmc2130_cs_low(uint8_t axis)
 {
@@ -301,47 +521,229 @@ static void tmc2130_cs_high(uint8_t axis)
 #define TMC2130_SPI_TXRX       spi_txrx
 #define TMC2130_SPI_LEAVE()
 
-void tmc2130_tx(uint8_t axis, uint8_t addr, uint32_t wval)
+//! @brief Send one datagram
+//!
+//! Driver answers each datagram with SPI status and the value requested by the
+//! previous datagram to the same axis, so reads are pipelined by the callers.
+//! @param axis axis
+//! @param addr register address, | 0x80 to write
+//! @param wval written value, 0 for read
+//! @param rval [out] response to previous datagram, may be 0
+//! @return SPI status
+static uint8_t tmc2130_datagram(uint8_t axis, uint8_t addr, uint32_t wval, uint32_t* rval)
 {
-	//datagram1 - request
+	tmc2130_jobs_wait();
 	TMC2130_SPI_ENTER();
 	tmc2130_cs_low(axis);
-	TMC2130_SPI_TXRX(addr); // address
-	TMC2130_SPI_TXRX((wval >> 24) & 0xff); // MSB
-	TMC2130_SPI_TXRX((wval >> 16) & 0xff);
-	TMC2130_SPI_TXRX((wval >> 8) & 0xff);
-	TMC2130_SPI_TXRX(wval & 0xff); // LSB
+	uint8_t stat = TMC2130_SPI_TXRX(addr); // address
+	uint32_t val32 = 0;
+	val32 = TMC2130_SPI_TXRX((wval >> 24) & 0xff); // MSB
+	val32 = (val32 << 8) | TMC2130_SPI_TXRX((wval >> 16) & 0xff);
+	val32 = (val32 << 8) | TMC2130_SPI_TXRX((wval >> 8) & 0xff);
+	val32 = (val32 << 8) | TMC2130_SPI_TXRX(wval & 0xff); // LSB
 	tmc2130_cs_high(axis);
 	TMC2130_SPI_LEAVE();
+	if (stat & 0x01) tmc2130_shadow_invalidate(axis); // reset flag
+	if (rval != 0) *rval = val32;
+	return stat;
+}
+
+void tmc2130_tx(uint8_t axis, uint8_t addr, uint32_t wval)
+{
+	if (tmc2130_shadow_match(axis, addr, wval))
+	{
+		tmc2130_count(&tmc2130_writes_skipped);
+		return;
+	}
+	tmc2130_datagram(axis, addr, wval, 0);
+	tmc2130_count(&tmc2130_writes_sent);
+	tmc2130_shadow_store(axis, addr, wval);
+}
+
+//! @name Asynchronous register access
+//!
+//! Jobs queued by tmc2130_job_submit() are run by the SPI transfer complete
+//! interrupt one byte at a time, so the caller goes on, e.g. queues steps,
+//! while the datagrams are exchanged. Read takes two datagrams, write one.
+//! Synchronous access waits until the queue is empty.
+//! @{
+#define TMC2130_JOB_QUEUE 4 // power of 2
+static tmc2130_job_t* volatile tmc2130_jobs[TMC2130_JOB_QUEUE];
+static volatile uint8_t tmc2130_job_head = 0; // written by main loop only
+static volatile uint8_t tmc2130_job_tail = 0; // written by interrupt only
+static uint8_t tmc2130_job_byte;  // byte of datagram being exchanged
+static uint8_t tmc2130_job_fetch; // response datagram of read is exchanged
+static uint8_t tmc2130_job_stat;
+static uint32_t tmc2130_job_val;
+//! @}
+
+static uint8_t tmc2130_job_next(uint8_t index)
+{
+	return (index + 1) & (TMC2130_JOB_QUEUE - 1);
+}
+
+//! @brief Byte of current datagram of job, address first
+static uint8_t tmc2130_job_tx(const tmc2130_job_t* job, uint8_t byte)
+{
+	if (tmc2130_job_fetch) return byte ? 0 : TMC2130_REG_GCONF;
+	if (byte == 0) return job->addr;
+	if (!(job->addr & 0x80)) return 0;
+	return (job->value >> (8 * (4 - byte))) & 0xff;
+}
+
+//! @brief Start datagram of oldest job, called with interrupts disabled
+static void tmc2130_job_start(void)
+{
+	const tmc2130_job_t* job = tmc2130_jobs[tmc2130_job_tail];
+	tmc2130_job_byte = 0;
+	spi_setup(TMC2130_SPCR | (1 << SPIE), TMC2130_SPSR);
+	tmc2130_cs_low(job->axis);
+	SPDR = tmc2130_job_tx(job, 0);
+}
+
+ISR(SPI_STC_vect)
+{
+	tmc2130_job_t* job = tmc2130_jobs[tmc2130_job_tail];
+	const uint8_t rx = SPDR;
+	if (tmc2130_job_byte == 0) tmc2130_job_stat = rx;
+	else tmc2130_job_val = (tmc2130_job_val << 8) | rx;
+	if (++tmc2130_job_byte < 5)
+	{
+		SPDR = tmc2130_job_tx(job, tmc2130_job_byte);
+		return;
+	}
+	tmc2130_cs_high(job->axis);
+	if (tmc2130_job_stat & 0x01) tmc2130_shadow_invalidate(job->axis); // reset flag
+	if (!(job->addr & 0x80) && !tmc2130_job_fetch)
+	{
+		tmc2130_job_fetch = 1;
+		tmc2130_job_start();
+		return;
+	}
+	tmc2130_job_fetch = 0;
+	if (job->addr & 0x80) tmc2130_shadow_store(job->axis, job->addr, job->value);
+	else job->value = tmc2130_job_val;
+	job->status = tmc2130_job_stat;
+	job->done = 1;
+	tmc2130_job_tail = tmc2130_job_next(tmc2130_job_tail);
+	if (tmc2130_job_tail != tmc2130_job_head) tmc2130_job_start();
+	else spi_setup(TMC2130_SPCR, TMC2130_SPSR); // SPI interrupt off
+}
+
+//! @brief Queue register access
+//!
+//! Job must stay valid until done. Write of the value the register already holds
+//! is done at once, see tmc2130_tx(). If the queue is full, waits for the oldest job.
+//! @param job axis, addr (| 0x80 to write) and value to write
+void tmc2130_job_submit(tmc2130_job_t* job)
+{
+	if ((job->addr & 0x80) && tmc2130_shadow_match(job->axis, job->addr, job->value))
+	{
+		tmc2130_count(&tmc2130_writes_skipped);
+		job->done = 1;
+		return;
+	}
+	if (job->addr & 0x80) tmc2130_count(&tmc2130_writes_sent); // counted here, not by interrupt
+	job->done = 0;
+	const uint8_t head = tmc2130_job_next(tmc2130_job_head);
+	if (head == tmc2130_job_tail) tmc2130_job_wait(tmc2130_jobs[tmc2130_job_tail]);
+	tmc2130_jobs[tmc2130_job_head] = job;
+	cli();
+	const uint8_t idle = (tmc2130_job_head == tmc2130_job_tail);
+	tmc2130_job_head = head;
+	if (idle) tmc2130_job_start();
+	sei();
+}
+
+//! @brief Sleep until job is done, SPI interrupt wakes the CPU
+void tmc2130_job_wait(const tmc2130_job_t* job)
+{
+	cli();
+	while (!job->done)
+	{
+		sleep_enable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+	sei();
+}
+
+//! @brief Wait until all queued jobs are done
+void tmc2130_jobs_wait(void)
+{
+	const uint8_t head = tmc2130_job_head;
+	if (head != tmc2130_job_tail) tmc2130_job_wait(tmc2130_jobs[(head - 1) & (TMC2130_JOB_QUEUE - 1)]);
+}
+
+//! @brief Are jobs queued or running?
+uint8_t tmc2130_jobs_pending(void)
+{
+	return tmc2130_job_head != tmc2130_job_tail;
+}
+
+//! @brief Queue read of StallGuard result, see tmc2130_wait_sg()
+void tmc2130_request_sg(tmc2130_job_t* job, uint8_t axis)
+{
+	job->axis = axis;
+	job->addr = TMC2130_REG_DRV_STATUS;
+	tmc2130_job_submit(job);
+}
+
+//! @brief Wait for read queued by tmc2130_request_sg()
+//! @return StallGuard result, see tmc2130_read_sg()
+uint16_t tmc2130_wait_sg(const tmc2130_job_t* job)
+{
+	tmc2130_job_wait(job);
+	return job->value & 0x3ff;
+}
+
+//! @brief Read registers of an axis, each request fetches the previous response
+//!
+//! count reads take count + 1 datagrams. The closing datagram reads GCONF,
+//! which has no side effect, unlike GSTAT which is cleared by read.
+//! @param axis axis
+//! @param addr register addresses
+//! @param rval [out] values, count elements
+//! @param count number of registers, 1 or more
+//! @return SPI status of last response
+uint8_t tmc2130_rd_batch(uint8_t axis, const uint8_t* addr, uint32_t* rval, uint8_t count)
+{
+	tmc2130_datagram(axis, addr[0], 0, 0);
+	for (uint8_t i = 1; i < count; ++i) tmc2130_datagram(axis, addr[i], 0, &rval[i - 1]);
+	return tmc2130_datagram(axis, TMC2130_REG_GCONF, 0, &rval[count - 1]);
 }
 
 uint8_t tmc2130_rx(uint8_t axis, uint8_t addr, uint32_t* rval)
 {
-	//datagram1 - request
-	TMC2130_SPI_ENTER();
-	tmc2130_cs_low(axis);
-	TMC2130_SPI_TXRX(addr); // address
-	TMC2130_SPI_TXRX(0); // MSB
-	TMC2130_SPI_TXRX(0);
-	TMC2130_SPI_TXRX(0);
-	TMC2130_SPI_TXRX(0); // LSB
-	tmc2130_cs_high(axis);
-	TMC2130_SPI_LEAVE();
-	//datagram2 - response
-	TMC2130_SPI_ENTER();
-	tmc2130_cs_low(axis);
-	uint8_t stat = TMC2130_SPI_TXRX(0); // status
-	uint32_t val32 = 0;
-	val32 = TMC2130_SPI_TXRX(0); // MSB
-	val32 = (val32 << 8) | TMC2130_SPI_TXRX(0);
-	val32 = (val32 << 8) | TMC2130_SPI_TXRX(0);
-	val32 = (val32 << 8) | TMC2130_SPI_TXRX(0); // LSB
-	tmc2130_cs_high(axis);
-	TMC2130_SPI_LEAVE();
+	uint32_t val32;
+	const uint8_t stat = tmc2130_rd_batch(axis, &addr, &val32, 1);
 	if (rval != 0) *rval = val32;
 	return stat;
 }
 
+//! @brief Read the same register of all axes
+//!
+//! Requests are sent to all axes before their responses are fetched, so the values
+//! are latched within a few microseconds of each other.
+//! @param addr register address
+//! @param rval [out] values indexed by axis
+static void tmc2130_rd_all(uint8_t addr, uint32_t rval[3])
+{
+	for (uint8_t axis = AX_PUL; axis <= AX_IDL; ++axis) tmc2130_datagram(axis, addr, 0, 0);
+	for (uint8_t axis = AX_PUL; axis <= AX_IDL; ++axis) tmc2130_datagram(axis, TMC2130_REG_GCONF, 0, &rval[axis]);
+}
+
+//! @brief Read DRV_STATUS of all axes at once
+//!
+//! StallGuard result is bits 0 to 9, see tmc2130_read_sg().
+//! @param drv_status [out] indexed by axis
+void tmc2130_read_drv_status_all(uint32_t drv_status[3])
+{
+	tmc2130_rd_all(TMC2130_REG_DRV_STATUS, drv_status);
+}
+
 //! @brief Read global error flags for all axis
 //!
 //! Error is detected if any of following flags is set.
@@ -353,16 +755,22 @@ uint8_t tmc2130_rx(uint8_t axis, uint8_t addr, uint32_t* rval)
 //!  * uv_cp
 //!    * Undervoltage on the charge pump. The driver is disabled in this case.
 //!
+//! Shadow copy of registers of an axis with error is dropped.
+//!
 //! @retval 0 no error
 //! @retval >0 error, bit flag set for each axis
 uint8_t tmc2130_read_gstat()
 {
     uint8_t retval = 0;
+    uint32_t result[3];
+    tmc2130_rd_all(TMC2130_REG_GSTAT, result);
     for (uint8_t axis = AX_PUL; axis <= AX_IDL ; ++ axis)
     {
-        uint32_t result;
-        tmc2130_rd(axis, TMC2130_REG_GSTAT, &result);
-        if (result & 0x7) retval += (1 << axis);
+        if (result[axis] & 0x7)
+        {
+            retval += (1 << axis);
+            tmc2130_shadow_invalidate(axis);
+        }
     }
     return retval;
 }
@@ -15,24 +15,55 @@
 #define TMC2130_CHECK_ENA 0x20
 #define TMC2130_CHECK_OK  0x3f
 
+// tmc2130_check_axis() durations
+#define TMC2130_CHECK_TIME_SPI  0 // SPI
+#define TMC2130_CHECK_TIME_PINS 1 // STP, DIR
+#define TMC2130_CHECK_TIME_LOAD 2 // MSC, MOC
+#define TMC2130_CHECK_TIME_ENA  3 // ENA
+#define TMC2130_CHECK_TIMES     4
+
 
 #if defined(__cplusplus)
 extern "C" {
 #endif //defined(__cplusplus)
 
+// Asynchronous register access, see tmc2130_job_submit()
+typedef struct
+{
+	uint8_t axis;
+	uint8_t addr;           // register address, | 0x80 to write
+	uint32_t value;         // value to write, read value once done
+	uint8_t status;         // SPI status once done
+	volatile uint8_t done;  // set by SPI interrupt
+} tmc2130_job_t;
+
 
 extern int8_t tmc2130_init(uint8_t mode);
 
 extern int8_t tmc2130_init_axis(uint8_t axis, uint8_t mode);
 extern int8_t tmc2130_init_axis_current_normal(uint8_t axis, uint8_t current_h, uint8_t current_r);
 extern int8_t tmc2130_init_axis_current_stealth(uint8_t axis, uint8_t current_h, uint8_t current_r);
-extern void tmc2130_disable_axis(uint8_t axis, uint8_t mode);
+extern void tmc2130_enable_axis(uint8_t axis);
+extern void tmc2130_disable_axis(uint8_t axis);
 
-extern uint8_t tmc2130_check_axis(uint8_t axis);
+extern uint8_t tmc2130_check_axis(uint8_t axis, uint16_t time_us[TMC2130_CHECK_TIMES]);
 
 extern uint16_t tmc2130_read_sg(uint8_t axis);
+extern void tmc2130_read_drv_status_all(uint32_t drv_status[3]);
+extern uint8_t tmc2130_rd_batch(uint8_t axis, const uint8_t* addr, uint32_t* rval, uint8_t count);
+extern uint16_t tmc2130_read_mscnt(uint8_t axis);
 extern uint8_t tmc2130_read_gstat();
 
+extern void tmc2130_job_submit(tmc2130_job_t* job);
+extern void tmc2130_job_wait(const tmc2130_job_t* job);
+extern void tmc2130_jobs_wait(void);
+extern uint8_t tmc2130_jobs_pending(void);
+extern void tmc2130_request_sg(tmc2130_job_t* job, uint8_t axis);
+extern uint16_t tmc2130_wait_sg(const tmc2130_job_t* job);
+
+extern uint16_t tmc2130_get_writes_sent(void);
+extern uint16_t tmc2130_get_writes_skipped(void);
+
 #if defined(__cplusplus)
 }
 #endif //defined(__cplusplus)
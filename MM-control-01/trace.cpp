@@ -0,0 +1,66 @@
+//! @file
+//! @brief Trace of printer link input on USB console
+
+#include "trace.h"
+#include <Arduino.h>
+
+namespace
+{
+
+const uint8_t buffer_size = 64; //!< power of 2
+
+bool s_enabled = false;
+uint8_t s_buffer[buffer_size];
+uint8_t s_head = 0; //!< next written
+uint8_t s_tail = 0; //!< next sent
+uint16_t s_dropped = 0; //!< saturates
+
+inline uint8_t next(uint8_t index)
+{
+    return (index + 1) & (buffer_size - 1);
+}
+
+} // unnamed namespace
+
+//! Disabling discards bytes not sent yet, they are not counted as dropped.
+void trace_enable(bool enable)
+{
+    s_enabled = enable;
+    if (!enable) s_tail = s_head;
+}
+
+//! @brief Queue received byte, constant time, never waits
+void trace_byte(uint8_t c)
+{
+    if (!s_enabled) return;
+    const uint8_t head = next(s_head);
+    if (head == s_tail)
+    {
+        if (s_dropped < UINT16_MAX) ++s_dropped;
+        return;
+    }
+    s_buffer[s_head] = c;
+    s_head = head;
+}
+
+//! @brief Send queued bytes USB CDC accepts without waiting
+//!
+//! Called from loop() and yield().
+void trace_flush()
+{
+    while (s_tail != s_head)
+    {
+        const int room = Serial.availableForWrite();
+        if (room <= 0) return;
+        uint8_t length = ((s_head > s_tail) ? s_head : buffer_size) - s_tail;
+        if (length > room) length = room;
+        Serial.write(s_buffer + s_tail, length);
+        s_tail = (s_tail + length) & (buffer_size - 1);
+    }
+}
+
+//! @return bytes dropped as the buffer was full, since reset
+uint16_t trace_dropped()
+{
+    return s_dropped;
+}
@@ -0,0 +1,20 @@
+//! @file
+//! @brief Trace of printer link input on USB console
+//!
+//! Off by default, enabled by D1 and disabled by D0. Bytes received in text
+//! protocol on the printer link are copied to a ring buffer and sent to the
+//! USB console by trace_flush() only as far as the USB CDC endpoint has room,
+//! so a USB host which does not read never slows down command handling.
+//! Bytes which do not fit the buffer are dropped and counted, read by S6.
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+void trace_enable(bool enable);
+void trace_byte(uint8_t c);
+void trace_flush();
+uint16_t trace_dropped();
+
+#endif //TRACE_H_
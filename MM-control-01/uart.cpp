@@ -2,6 +2,8 @@
 
 #include "uart.h"
 #include "Arduino.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
 #include "config.h"
 
 
@@ -9,6 +11,76 @@ FILE _uart0io;
 
 FILE _uart1io;
 
+//! @name UART1 driver
+//!
+//! Replaces Serial1 of the Arduino core, its receive interrupt can not recognize
+//! the printer filament sensor token, see uart1_rx_token(), nor count receive errors.
+//! Buffer sizes are set in config.h.
+//! @{
+static_assert(UART1_RX_BUFFER_SIZE <= 256 && !(UART1_RX_BUFFER_SIZE & (UART1_RX_BUFFER_SIZE - 1)), "UART1_RX_BUFFER_SIZE not power of 2 up to 256");
+static_assert(UART1_TX_BUFFER_SIZE <= 256 && !(UART1_TX_BUFFER_SIZE & (UART1_TX_BUFFER_SIZE - 1)), "UART1_TX_BUFFER_SIZE not power of 2 up to 256");
+static volatile uint8_t s_rx1_buffer[UART1_RX_BUFFER_SIZE];
+static volatile uint8_t s_rx1_head = 0; //!< written by interrupt only
+static volatile uint8_t s_rx1_tail = 0; //!< written by main loop only
+static volatile uint8_t s_tx1_buffer[UART1_TX_BUFFER_SIZE];
+static volatile uint8_t s_tx1_head = 0; //!< written by main loop only
+static volatile uint8_t s_tx1_tail = 0; //!< written by interrupt only
+static uint8_t s_rx1_token = 0; //!< uart1_rx_token() state
+static volatile bool s_filament_sensed = false; //!< printer sent 'A'
+static volatile uint16_t s_errors[3]; //!< uart1_error_count(), written by interrupt only
+//! @}
+
+static inline uint8_t uart1_rx_next(uint8_t index)
+{
+	return (index + 1) & (UART1_RX_BUFFER_SIZE - 1);
+}
+
+static inline uint8_t uart1_tx_next(uint8_t index)
+{
+	return (index + 1) & (UART1_TX_BUFFER_SIZE - 1);
+}
+
+static inline void uart1_error(uint8_t error)
+{
+	if (s_errors[error] < UINT16_MAX) ++s_errors[error];
+}
+
+ISR(USART1_RX_vect)
+{
+	const uint8_t status = UCSR1A;
+	const uint8_t c = UDR1;
+	if (status & (1 << DOR1)) uart1_error(UART1_ERR_OVERFLOW); //byte before this one lost
+	if (status & (1 << FE1))
+	{
+		uart1_error(UART1_ERR_FRAME);
+		return;
+	}
+	if (status & (1 << UPE1))
+	{
+		uart1_error(UART1_ERR_PARITY);
+		return;
+	}
+	if (uart1_rx_token(c, s_rx1_token))
+	{
+		s_filament_sensed = true;
+		return;
+	}
+	const uint8_t next = uart1_rx_next(s_rx1_head);
+	if (next == s_rx1_tail)
+	{
+		uart1_error(UART1_ERR_OVERFLOW);
+		return;
+	}
+	s_rx1_buffer[s_rx1_head] = c;
+	s_rx1_head = next;
+}
+
+ISR(USART1_UDRE_vect)
+{
+	UDR1 = s_tx1_buffer[s_tx1_tail];
+	s_tx1_tail = uart1_tx_next(s_tx1_tail);
+	if (s_tx1_tail == s_tx1_head) UCSR1B &= ~(1 << UDRIE1);
+}
 
 int uart0_putchar(char c, FILE *)
 {
@@ -23,12 +95,42 @@ int uart0_getchar(FILE *)
 
 int uart1_putchar(char c, FILE *)
 {
-	Serial1.write(c);
+	const uint8_t next = uart1_tx_next(s_tx1_head);
+	while (next == s_tx1_tail); //buffer full, wait for transmit interrupt
+	s_tx1_buffer[s_tx1_head] = c;
+	cli();
+	s_tx1_head = next;
+	UCSR1B |= (1 << UDRIE1);
+	sei();
 	return 0;
 }
 int uart1_getchar(FILE *)
 {
-	return Serial1.read();
+	if (s_rx1_head == s_rx1_tail) return -1;
+	const uint8_t c = s_rx1_buffer[s_rx1_tail];
+	s_rx1_tail = uart1_rx_next(s_rx1_tail);
+	return c;
+}
+
+//! @brief Printer sent 'A' since last call
+//!
+//! Flag set by receive interrupt is read and cleared, constant time.
+bool uart1_take_filament_sensed(void)
+{
+	if (!s_filament_sensed) return false;
+	s_filament_sensed = false;
+	return true;
+}
+
+//! @brief Receive errors since reset
+//! @param error UART1_ERR_OVERFLOW, UART1_ERR_FRAME or UART1_ERR_PARITY
+//! @return count, saturates at 65535
+uint16_t uart1_error_count(uint8_t error)
+{
+	cli();
+	const uint16_t count = s_errors[error];
+	sei();
+	return count;
 }
 
 
@@ -40,6 +142,9 @@ void uart0_init(void)
 
 void uart1_init(void)
 {
-	Serial1.begin(UART1_BDR, SERIAL_8N2); //serial1
+	UCSR1A = (1 << U2X1); //double speed, as Serial1.begin()
+	UBRR1 = (F_CPU / 8 + UART1_BDR / 2) / UART1_BDR - 1;
+	UCSR1C = (1 << USBS1) | (1 << UCSZ11) | (1 << UCSZ10); //8N2
+	UCSR1B = (1 << RXEN1) | (1 << TXEN1) | (1 << RXCIE1);
 	fdev_setup_stream(uart1io, uart1_putchar, uart1_getchar, _FDEV_SETUP_WRITE | _FDEV_SETUP_READ); //setup uart in/out stream
 }
@@ -12,10 +12,56 @@ extern FILE _uart0io;
 extern FILE _uart1io;
 #define uart1io (&_uart1io)
 
+const uint8_t frame_start = 0xa5;       //!< first byte of binary protocol frame
+const uint8_t frame_payload_max = 4;    //!< longest payload of received frame
+
 
 extern void uart0_init(void);
 
 extern void uart1_init(void);
 
+extern bool uart1_take_filament_sensed(void);
+
+//UART1 receive errors, see uart1_error_count()
+#define UART1_ERR_OVERFLOW 0 // byte lost, receive buffer full or data overrun
+#define UART1_ERR_FRAME    1 // stop bit missing, byte dropped
+#define UART1_ERR_PARITY   2 // byte dropped
+
+extern uint16_t uart1_error_count(uint8_t error);
+
+//! @brief Take printer filament sensor token out of UART1 receive stream
+//!
+//! Printer sends 'A' when its filament sensor detects the filament tip. It comes
+//! between command lines or binary protocol frames, so the receive interrupt tracks
+//! their boundaries. 'A' inside a line or frame is passed to the command parser.
+//! @param c received byte
+//! @param state position in line or frame, 0 at boundary, owned by receive interrupt
+//! @retval true byte is the token, not put to receive buffer
+//! @retval false byte goes to receive buffer
+inline bool uart1_rx_token(uint8_t c, uint8_t &state)
+{
+	const uint8_t in_line = 0xff;
+	const uint8_t frame_length = 0xfe;
+	switch (state)
+	{
+	case 0:
+		if (c == 'A') return true;
+		if (c == frame_start) state = frame_length;
+		else if ((c != '\r') && (c != '\n')) state = in_line;
+		break;
+	case in_line:
+		if ((c == '\r') || (c == '\n')) state = 0;
+		else if (c == frame_start) state = frame_length; //resynchronize after invalid frame
+		break;
+	case frame_length:
+		state = (c > frame_payload_max) ? 0 : (c + 3); //sequence, opcode, payload, CRC
+		break;
+	default:
+		--state;
+		break;
+	}
+	return false;
+}
+
 
 #endif //_UART_H
@@ -0,0 +1,88 @@
+//! @file
+//! @brief Simulated Arduino core
+//!
+//! Subset of the Arduino API used by the firmware. Time only advances
+//! through these calls and through I/O register accesses.
+
+#ifndef SIM_ARDUINO_H_
+#define SIM_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "binary.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+
+#define min(a,b) ((a)<(b)?(a):(b))
+#define max(a,b) ((a)>(b)?(a):(b))
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+//Arduino Leonardo analog pins
+#define A0 18
+#define A1 19
+#define A2 20
+#define A3 21
+#define A4 22
+#define A5 23
+
+#define SERIAL_8N1 0x06
+#define SERIAL_8N2 0x0E
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+//! Calls yield() every millisecond like the AVR core does
+void delay(unsigned long ms);
+//! unsigned int is 16 bit on AVR, keep the truncation firmware relies on
+void delayMicroseconds(uint16_t us);
+//! Does nothing unless defined by the firmware
+void yield(void);
+
+//! @brief Simulated UART
+//!
+//! Port 0 is the USB CDC console, port 1 is the printer link.
+class HardwareSerial
+{
+public:
+    explicit constexpr HardwareSerial(uint8_t port) : m_port(port) {}
+    void begin(unsigned long baud, uint8_t config = SERIAL_8N1);
+    void end() {}
+    int available(void);
+    int peek(void);
+    int read(void);
+    int availableForWrite(void);
+    void flush(void);
+    size_t write(uint8_t c);
+    size_t write(const char* str);
+    size_t write(const uint8_t* buffer, size_t size);
+    operator bool() { return true; }
+private:
+    uint8_t m_port;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+#endif //SIM_ARDUINO_H_
@@ -0,0 +1,48 @@
+//! @file
+//! @brief Simulated SSD1306Ascii library
+//!
+//! Nothing is drawn. Text output costs the I2C time the glyph data would need.
+
+#ifndef SIM_SSD1306ASCII_H_
+#define SIM_SSD1306ASCII_H_
+
+#include <Arduino.h>
+
+#define GLCDFONTDECL(_n) static const uint8_t _n[] PROGMEM
+
+//! @brief Font header only, {size, size, width, height, first char, char count}
+GLCDFONTDECL(Arial_bold_14) = {0x00, 0x00, 0x0E, 0x0E, 0x20, 0x60};
+GLCDFONTDECL(Adafruit5x7) = {0x00, 0x00, 0x05, 0x07, 0x20, 0x60};
+
+struct DevType
+{
+    uint8_t lcdWidth;
+    uint8_t lcdHeight;
+};
+
+static const DevType Adafruit128x64 = {128, 64};
+
+class SSD1306Ascii
+{
+public:
+    void clear();
+    void setFont(const uint8_t* font) { m_font = font; }
+    void setInvertMode(bool mode) { m_invert = mode; }
+    void setCursor(uint8_t col, uint8_t row);
+    uint8_t col() const { return m_col; }
+    uint8_t row() const { return m_row; }
+    size_t strWidth(const char* str) const;
+    size_t write(const char* str);
+    size_t write(uint8_t c);
+protected:
+    void transfer(uint16_t bytes);
+private:
+    uint8_t fontWidth() const { return m_font ? m_font[2] : 5; }
+    uint8_t fontRows() const { return m_font ? ((m_font[3] + 7) / 8) : 1; }
+    const uint8_t* m_font = nullptr;
+    bool m_invert = false;
+    uint8_t m_col = 0;
+    uint8_t m_row = 0;
+};
+
+#endif //SIM_SSD1306ASCII_H_
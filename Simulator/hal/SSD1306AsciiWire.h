@@ -0,0 +1,16 @@
+//! @file
+//! @brief Simulated SSD1306AsciiWire library
+
+#ifndef SIM_SSD1306ASCIIWIRE_H_
+#define SIM_SSD1306ASCIIWIRE_H_
+
+#include <Wire.h>
+#include "SSD1306Ascii.h"
+
+class SSD1306AsciiWire : public SSD1306Ascii
+{
+public:
+    void begin(const DevType* dev, uint8_t i2cAddr, int8_t rst = -1) { (void)dev; (void)i2cAddr; (void)rst; clear(); }
+};
+
+#endif //SIM_SSD1306ASCIIWIRE_H_
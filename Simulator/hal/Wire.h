@@ -0,0 +1,21 @@
+//! @file
+//! @brief Simulated I2C bus
+
+#ifndef SIM_WIRE_H_
+#define SIM_WIRE_H_
+
+#include <Arduino.h>
+
+class TwoWire
+{
+public:
+    void begin() {}
+    void setClock(uint32_t clock) { m_clock = clock; }
+    uint32_t getClock() const { return m_clock; }
+private:
+    uint32_t m_clock = 100000;
+};
+
+extern TwoWire Wire;
+
+#endif //SIM_WIRE_H_
@@ -0,0 +1,16 @@
+//! @file
+//! @brief Simulated EEPROM of ATmega32U4
+
+#ifndef SIM_AVR_EEPROM_H_
+#define SIM_AVR_EEPROM_H_
+
+#include <stdint.h>
+
+#define E2END 1023u
+
+uint8_t eeprom_read_byte(const uint8_t* p);
+uint16_t eeprom_read_word(const uint16_t* p);
+void eeprom_update_byte(uint8_t* p, uint8_t value);
+void eeprom_update_word(uint16_t* p, uint16_t value);
+
+#endif //SIM_AVR_EEPROM_H_
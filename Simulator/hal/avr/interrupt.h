@@ -0,0 +1,23 @@
+//! @file
+//! @brief Simulated interrupts
+//!
+//! Interrupt service routines are called by the simulator when their
+//! event is due, interrupts enabled and the routine is not already running.
+
+#ifndef SIM_AVR_INTERRUPT_H_
+#define SIM_AVR_INTERRUPT_H_
+
+namespace sim
+{
+void sei();
+void cli();
+}
+
+#define sei() sim::sei()
+#define cli() sim::cli()
+
+#define ISR(vector) extern "C" void vector(void)
+#define TIMER1_COMPA_vect sim_timer1_compa_vect
+#define SPI_STC_vect sim_spi_stc_vect
+
+#endif //SIM_AVR_INTERRUPT_H_
@@ -0,0 +1,116 @@
+//! @file
+//! @brief Simulated AVR I/O registers
+//!
+//! Every register is an object, so each access made by the firmware reaches
+//! the board model in sim.cpp and costs virtual time.
+
+#ifndef SIM_AVR_IO_H_
+#define SIM_AVR_IO_H_
+
+#include <stdint.h>
+
+namespace sim
+{
+
+enum class RegId : uint8_t
+{
+    pinb, ddrb, portb,
+    pinc, ddrc, portc,
+    pind, ddrd, portd,
+    pine, ddre, porte,
+    pinf, ddrf, portf,
+    spcr, spsr, spdr,
+    tccr1a, tccr1b, tccr1c, timsk1, tifr1,
+    tcnt1l, tcnt1h, ocr1al, ocr1ah,
+    count,
+};
+
+uint8_t reg_read(RegId id);
+void reg_write(RegId id, uint8_t value);
+
+//! @brief 8-bit I/O register
+//!
+//! Read-modify-write operators do one read and one write, as the AVR does.
+class Reg8
+{
+public:
+    explicit constexpr Reg8(RegId id) : m_id(id) {}
+    operator uint8_t() const { return reg_read(m_id); }
+    const Reg8& operator=(uint8_t value) const { reg_write(m_id, value); return *this; }
+    const Reg8& operator|=(int value) const { return *this = static_cast<uint8_t>(reg_read(m_id) | value); }
+    const Reg8& operator&=(int value) const { return *this = static_cast<uint8_t>(reg_read(m_id) & value); }
+    const Reg8& operator^=(int value) const { return *this = static_cast<uint8_t>(reg_read(m_id) ^ value); }
+private:
+    RegId m_id;
+};
+
+//! @brief 16-bit timer register
+//!
+//! Accessed as a whole, as the AVR does using its TEMP register.
+class Reg16
+{
+public:
+    explicit constexpr Reg16(RegId low) : m_low(low) {}
+    operator uint16_t() const;
+    const Reg16& operator=(uint16_t value) const;
+private:
+    RegId m_low;
+};
+
+} // namespace sim
+
+#define PINB  (sim::Reg8(sim::RegId::pinb))
+#define DDRB  (sim::Reg8(sim::RegId::ddrb))
+#define PORTB (sim::Reg8(sim::RegId::portb))
+#define PINC  (sim::Reg8(sim::RegId::pinc))
+#define DDRC  (sim::Reg8(sim::RegId::ddrc))
+#define PORTC (sim::Reg8(sim::RegId::portc))
+#define PIND  (sim::Reg8(sim::RegId::pind))
+#define DDRD  (sim::Reg8(sim::RegId::ddrd))
+#define PORTD (sim::Reg8(sim::RegId::portd))
+#define PINE  (sim::Reg8(sim::RegId::pine))
+#define DDRE  (sim::Reg8(sim::RegId::ddre))
+#define PORTE (sim::Reg8(sim::RegId::porte))
+#define PINF  (sim::Reg8(sim::RegId::pinf))
+#define DDRF  (sim::Reg8(sim::RegId::ddrf))
+#define PORTF (sim::Reg8(sim::RegId::portf))
+#define SPCR  (sim::Reg8(sim::RegId::spcr))
+#define SPSR  (sim::Reg8(sim::RegId::spsr))
+#define SPDR  (sim::Reg8(sim::RegId::spdr))
+#define TCCR1A (sim::Reg8(sim::RegId::tccr1a))
+#define TCCR1B (sim::Reg8(sim::RegId::tccr1b))
+#define TCCR1C (sim::Reg8(sim::RegId::tccr1c))
+#define TIMSK1 (sim::Reg8(sim::RegId::timsk1))
+#define TIFR1  (sim::Reg8(sim::RegId::tifr1))
+#define TCNT1  (sim::Reg16(sim::RegId::tcnt1l))
+#define OCR1A  (sim::Reg16(sim::RegId::ocr1al))
+
+//SPCR
+#define SPR0  0
+#define SPR1  1
+#define CPHA  2
+#define CPOL  3
+#define MSTR  4
+#define DORD  5
+#define SPE   6
+#define SPIE  7
+//SPSR
+#define SPI2X 0
+#define WCOL  6
+#define SPIF  7
+//TCCR1A
+#define WGM10 0
+#define WGM11 1
+//TCCR1B
+#define CS10  0
+#define CS11  1
+#define CS12  2
+#define WGM12 3
+#define WGM13 4
+//TIMSK1, TIFR1
+#define TOIE1  0
+#define OCIE1A 1
+#define TOV1   0
+#define OCF1A  1
+
+#endif //SIM_AVR_IO_H_
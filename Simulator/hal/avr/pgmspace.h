@@ -0,0 +1,33 @@
+//! @file
+//! @brief Simulated program memory access
+//!
+//! The host has a single address space, so program memory helpers map
+//! to their plain libc counterparts.
+
+#ifndef SIM_AVR_PGMSPACE_H_
+#define SIM_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char*
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(void* const*)(addr))
+
+#define printf_P printf
+#define fprintf_P fprintf
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define sscanf_P sscanf
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+#endif //SIM_AVR_PGMSPACE_H_
@@ -0,0 +1,21 @@
+//! @file
+//! @brief Simulated sleep modes
+//!
+//! Sleep advances time to the next interrupt. Only idle mode is simulated.
+
+#ifndef SIM_AVR_SLEEP_H_
+#define SIM_AVR_SLEEP_H_
+
+namespace sim
+{
+void sleep_cpu();
+}
+
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu() sim::sleep_cpu()
+#define sleep_mode() sim::sleep_cpu()
+
+#endif //SIM_AVR_SLEEP_H_
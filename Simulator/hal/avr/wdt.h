@@ -0,0 +1,27 @@
+//! @file
+//! @brief Simulated watchdog
+
+#ifndef SIM_AVR_WDT_H_
+#define SIM_AVR_WDT_H_
+
+#include <stdint.h>
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+
+namespace sim
+{
+void wdt_enable(uint8_t timeout);
+}
+
+#define wdt_enable(timeout) sim::wdt_enable(timeout)
+#define wdt_reset()
+#define wdt_disable()
+
+#endif //SIM_AVR_WDT_H_
@@ -0,0 +1,687 @@
+//! @file
+//! @brief MMU board simulator
+
+#include "sim.h"
+#include "sim_internal.h"
+#include <algorithm>
+#include <array>
+#include <stdio.h>
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include "config.h"
+
+namespace sim
+{
+
+namespace
+{
+
+//! @name Cost of firmware visible operations [cycles]
+//! @{
+const uint32_t io_cycles = 2;            //!< SBI/CBI/IN/OUT
+const uint32_t digital_read_cycles = 60; //!< Arduino digitalRead() pin lookup
+const uint32_t analog_read_cycles = 1700;//!< 13 ADC clocks at 125 kHz and overhead
+const uint32_t eeprom_read_cycles = 20;
+const uint32_t eeprom_write_cycles = cpu_hz / 1000 * 34 / 10; //!< 3.4 ms erase and write
+//! @}
+
+const uint16_t shr16_dir[3] = {SHR16_DIR_0, SHR16_DIR_1, SHR16_DIR_2};
+const uint16_t shr16_ena[3] = {SHR16_ENA_0, SHR16_ENA_1, SHR16_ENA_2};
+
+#ifdef REVERSE_PULLEY
+const bool reverse_pulley = true;
+#else
+const bool reverse_pulley = false;
+#endif
+#ifdef REVERSE_SELECTOR
+const bool reverse_selector = true;
+#else
+const bool reverse_selector = false;
+#endif
+#ifdef REVERSE_IDLER
+const bool reverse_idler = true;
+#else
+const bool reverse_idler = false;
+#endif
+
+const uint8_t reg_gconf = 0x00;
+const uint8_t reg_gstat = 0x01;
+const uint8_t reg_ioin = 0x04;
+const uint8_t reg_ihold_irun = 0x10;
+const uint8_t reg_mscnt = 0x6a;
+const uint8_t reg_chopconf = 0x6c;
+const uint8_t reg_drv_status = 0x6f;
+
+const uint16_t sg_free = 300; //!< StallGuard reading of freely moving axis
+
+//! @brief TMC2130 SPI side and step counter
+struct Driver
+{
+    uint32_t reg[0x80];
+    uint8_t gstat;
+    uint8_t rx[5];
+    uint8_t tx[5];
+    uint8_t count;
+    uint32_t response;
+    uint16_t mscnt;
+    bool stalled;
+    bool step;
+};
+
+uint64_t s_cycles;
+uint64_t s_limit;
+Options s_options;
+Stats s_stats;
+bool s_watchdog;
+
+uint8_t s_reg[static_cast<uint8_t>(RegId::count)];
+uint8_t s_spi_rx;
+bool s_spif;            //!< transfer started, SPIF set once s_spi_done is reached
+uint64_t s_spi_done;    //!< cycle the last transfer completes
+
+uint16_t s_shift;
+uint16_t s_shr16;
+
+Driver s_driver[3];
+int32_t s_pos[3];
+float s_tip[EXTRUDERS];
+bool s_sensor_reported;
+
+std::array<uint8_t, E2END + 1> s_eeprom;
+
+Button s_button;
+uint64_t s_button_until;
+
+const float pulley_mm_per_step = 1.0f / (PULLEY_STEPS_PER_MM);
+
+float selector_clear_mm()
+{
+    return (s_options.selector_clear_mm < 0) ? (FILAMENT_RETRACT_MM / 2) : s_options.selector_clear_mm;
+}
+
+//! @brief Nearest slot within tolerance
+//! @param pos axis position
+//! @param first position of slot 0
+//! @param pitch distance between slots, signed
+//! @param count number of slots
+//! @param tolerance maximum distance from slot position
+//! @retval -1 no slot
+int8_t nearest_slot(int32_t pos, float first, float pitch, uint8_t count, float tolerance)
+{
+    for (uint8_t i = 0; i < count; ++i)
+    {
+        float slot = first + pitch * i;
+        if (((pos - slot) <= tolerance) && ((slot - pos) <= tolerance)) return i;
+    }
+    return -1;
+}
+
+bool energized(uint8_t axis)
+{
+    const Driver &d = s_driver[axis];
+    const bool enabled = !(s_shr16 & shr16_ena[axis]);
+    const bool toff = d.reg[reg_chopconf] & 0x0f;
+    const bool irun = (d.reg[reg_ihold_irun] >> 8) & 0x1f;
+    return enabled && toff && irun;
+}
+
+//! @brief Direction of step in firmware sign convention
+//!
+//! Positive is towards homing end stop for selector and idler, push for pulley.
+bool positive(uint8_t axis)
+{
+    const bool bit = s_shr16 & shr16_dir[axis];
+    switch (axis)
+    {
+    case AX_PUL: return bit == reverse_pulley;
+    case AX_SEL: return bit != reverse_selector;
+    case AX_IDL: return bit != reverse_idler;
+    }
+    return true;
+}
+
+void lose_step(uint8_t axis)
+{
+    ++s_stats.axis[axis].lost_steps;
+}
+
+void move_filament(float mm)
+{
+    const int8_t slot = idler_slot();
+    if (slot < 0) return; //pulley spins freely
+    float tip = s_tip[slot] + mm;
+    if ((mm > 0) && (tip > -selector_clear_mm()) && (selector_slot() != slot))
+    {
+        ++s_stats.filament_jams;
+        lose_step(AX_PUL);
+        return;
+    }
+    if (s_options.printer_filament_sensor)
+    {
+        if ((tip >= FILAMENT_BOWDEN_MM) && !s_sensor_reported)
+        {
+            s_sensor_reported = true;
+            host_send(UART_COM, "A");
+        }
+        else if (tip < FILAMENT_BOWDEN_MM) s_sensor_reported = false;
+    }
+    s_tip[slot] = tip;
+    ++s_stats.axis[AX_PUL].steps;
+}
+
+void move_end_stop(uint8_t axis, int32_t lowest)
+{
+    Driver &d = s_driver[axis];
+    const int32_t pos = s_pos[axis] + (positive(axis) ? 1 : -1);
+    if ((pos > 0) || (pos < lowest))
+    {
+        d.stalled = true;
+        lose_step(axis);
+        return;
+    }
+    d.stalled = false;
+    s_pos[axis] = pos;
+    ++s_stats.axis[axis].steps;
+}
+
+void step(uint8_t axis)
+{
+    Driver &d = s_driver[axis];
+    if (s_shr16 & shr16_ena[axis]) return; //driver disabled, STEP is ignored
+
+    const uint8_t mres = (d.reg[reg_chopconf] >> 24) & 0x0f;
+    d.mscnt = (d.mscnt + (positive(axis) ? (1 << mres) : (1024 - (1 << mres)))) & 0x3ff;
+
+    AxisStats &st = s_stats.axis[axis];
+    if (st.last_step)
+    {
+        const uint32_t interval = (s_cycles - st.last_step) / (cpu_hz / 1000000);
+        if (!st.min_interval || (interval < st.min_interval)) st.min_interval = interval;
+    }
+    st.last_step = s_cycles;
+
+    if (!energized(axis))
+    {
+        lose_step(axis);
+        return;
+    }
+
+    switch (axis)
+    {
+    case AX_PUL:
+        move_filament(positive(axis) ? pulley_mm_per_step : -pulley_mm_per_step);
+        break;
+    case AX_SEL:
+    {
+        const int8_t slot = selector_slot();
+        if ((slot >= 0) && (s_tip[slot] > -selector_clear_mm())) ++s_stats.selector_violations;
+        move_end_stop(axis, SELECTOR_STEPS_AFTER_HOMING - SELECTOR_STEPS);
+        break;
+    }
+    case AX_IDL:
+        move_end_stop(axis, INT32_MIN);
+        break;
+    }
+}
+
+uint32_t driver_read(uint8_t axis, uint8_t addr)
+{
+    Driver &d = s_driver[axis];
+    switch (addr)
+    {
+    case reg_gstat:
+    {
+        const uint32_t gstat = d.gstat;
+        d.gstat = 0;
+        return gstat;
+    }
+    case reg_ioin:
+        return 0x11000000ul
+            | (d.step ? 0x01 : 0)
+            | ((s_shr16 & shr16_dir[axis]) ? 0x02 : 0)
+            | ((s_shr16 & shr16_ena[axis]) ? 0x10 : 0);
+    case reg_mscnt:
+        return d.mscnt;
+    case reg_drv_status:
+        return (d.stalled ? (1ul << 24) : sg_free);
+    case reg_gconf:
+    case reg_chopconf:
+        return d.reg[addr];
+    default:
+        return 0; //write only register
+    }
+}
+
+void cs_low(uint8_t axis)
+{
+    Driver &d = s_driver[axis];
+    d.count = 0;
+    d.tx[0] = (d.gstat & 0x03) | ((d.stalled) ? 0x04 : 0);
+    d.tx[1] = d.response >> 24;
+    d.tx[2] = d.response >> 16;
+    d.tx[3] = d.response >> 8;
+    d.tx[4] = d.response;
+}
+
+void cs_high(uint8_t axis)
+{
+    Driver &d = s_driver[axis];
+    if (d.count != 5) return;
+    ++s_stats.spi_datagrams;
+    const uint8_t addr = d.rx[0] & 0x7f;
+    const uint32_t val = (static_cast<uint32_t>(d.rx[1]) << 24) | (static_cast<uint32_t>(d.rx[2]) << 16)
+        | (static_cast<uint32_t>(d.rx[3]) << 8) | d.rx[4];
+    if (d.rx[0] & 0x80)
+    {
+        d.reg[addr] = val;
+        d.response = val;
+    }
+    else d.response = driver_read(axis, addr);
+}
+
+//! @brief Axis selected by chip select, -1 none or more of them
+int8_t spi_selected()
+{
+    const bool cs0 = !(s_reg[static_cast<uint8_t>(RegId::portc)] & 0x40);
+    const bool cs1 = !(s_reg[static_cast<uint8_t>(RegId::portd)] & 0x80);
+    const bool cs2 = !(s_reg[static_cast<uint8_t>(RegId::portb)] & 0x80);
+    if (cs0 + cs1 + cs2 != 1) return -1;
+    return cs0 ? AX_PUL : (cs1 ? AX_SEL : AX_IDL);
+}
+
+void spi_transfer(uint8_t tx)
+{
+    static const uint8_t divider[4] = {4, 16, 64, 128};
+    const uint8_t spcr = s_reg[static_cast<uint8_t>(RegId::spcr)];
+    const bool spi2x = s_reg[static_cast<uint8_t>(RegId::spsr)] & (1 << SPI2X);
+    s_spi_done = s_cycles + 8u * divider[spcr & 3] / (spi2x ? 2 : 1);
+    s_spif = true;
+    ++s_stats.spi_bytes;
+
+    s_spi_rx = 0xff;
+    const int8_t axis = spi_selected();
+    if (axis < 0) return;
+    Driver &d = s_driver[axis];
+    if (d.count < 5)
+    {
+        s_spi_rx = d.tx[d.count];
+        d.rx[d.count++] = tx;
+    }
+}
+
+bool rising(uint8_t before, uint8_t after, uint8_t mask)
+{
+    return !(before & mask) && (after & mask);
+}
+
+bool falling(uint8_t before, uint8_t after, uint8_t mask)
+{
+    return (before & mask) && !(after & mask);
+}
+
+void port_b(uint8_t before, uint8_t after)
+{
+    if (rising(before, after, 0x10)) step(AX_PUL);
+    s_driver[AX_PUL].step = after & 0x10;
+    if (rising(before, after, 0x40))
+    {
+        s_shr16 = s_shift;
+        ++s_stats.shr16_writes;
+    }
+    if (falling(before, after, 0x80)) cs_low(AX_IDL);
+    if (rising(before, after, 0x80)) cs_high(AX_IDL);
+}
+
+void port_c(uint8_t before, uint8_t after)
+{
+    if (falling(before, after, 0x40)) cs_low(AX_PUL);
+    if (rising(before, after, 0x40)) cs_high(AX_PUL);
+    if (rising(before, after, 0x80))
+    {
+        const bool data = s_reg[static_cast<uint8_t>(RegId::portb)] & 0x20;
+        s_shift = (s_shift << 1) | (data ? 1 : 0);
+    }
+}
+
+void port_d(uint8_t before, uint8_t after)
+{
+    if (rising(before, after, 0x10)) step(AX_SEL);
+    s_driver[AX_SEL].step = after & 0x10;
+    if (rising(before, after, 0x40)) step(AX_IDL);
+    s_driver[AX_IDL].step = after & 0x40;
+    if (falling(before, after, 0x80)) cs_low(AX_SEL);
+    if (rising(before, after, 0x80)) cs_high(AX_SEL);
+}
+
+} // unnamed namespace
+
+void power_on(const Options& options)
+{
+    s_cycles = 0;
+    s_limit = 0;
+    s_options = options;
+    s_stats = Stats();
+    s_watchdog = false;
+    std::fill(std::begin(s_reg), std::end(s_reg), 0);
+    s_spi_rx = 0;
+    s_spif = false;
+    s_spi_done = 0;
+    s_shift = 0;
+    s_shr16 = 0;
+    for (Driver &d : s_driver)
+    {
+        d = Driver();
+        d.gstat = 0x01; //reset flag
+    }
+    s_pos[AX_PUL] = 0;
+    s_pos[AX_SEL] = options.selector_start;
+    s_pos[AX_IDL] = options.idler_start;
+    std::fill(std::begin(s_tip), std::end(s_tip), options.filament_start_mm);
+    s_sensor_reported = false;
+    s_eeprom.fill(0xff);
+    s_button = Button::none;
+    s_button_until = 0;
+    uart_reset();
+    phase_reset();
+    timer_reset();
+}
+
+namespace
+{
+
+//! @brief State surviving MCU reset, file format of save_state()
+struct State
+{
+    std::array<uint8_t, E2END + 1> eeprom;
+    int32_t pos[3];
+    float tip[EXTRUDERS];
+    uint16_t mscnt[3];
+};
+
+} // unnamed namespace
+
+bool save_state(const char* path)
+{
+    State state;
+    state.eeprom = s_eeprom;
+    std::copy(std::begin(s_pos), std::end(s_pos), std::begin(state.pos));
+    std::copy(std::begin(s_tip), std::end(s_tip), std::begin(state.tip));
+    for (uint8_t axis = 0; axis < 3; ++axis) state.mscnt[axis] = s_driver[axis].mscnt;
+    FILE* file = fopen(path, "wb");
+    if (!file) return false;
+    const bool ok = (fwrite(&state, sizeof(state), 1, file) == 1);
+    return (fclose(file) == 0) && ok;
+}
+
+bool load_state(const char* path)
+{
+    State state;
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    const bool ok = (fread(&state, sizeof(state), 1, file) == 1);
+    fclose(file);
+    if (!ok) return false;
+    s_eeprom = state.eeprom;
+    std::copy(std::begin(state.pos), std::end(state.pos), std::begin(s_pos));
+    std::copy(std::begin(state.tip), std::end(state.tip), std::begin(s_tip));
+    for (uint8_t axis = 0; axis < 3; ++axis)
+    {
+        s_driver[axis].mscnt = state.mscnt[axis];
+        s_driver[axis].gstat = 0; //drivers stayed powered, no reset reported
+    }
+    return true;
+}
+
+uint64_t cycles()
+{
+    return s_cycles;
+}
+
+double seconds()
+{
+    return static_cast<double>(s_cycles) / cpu_hz;
+}
+
+void advance(uint64_t cycles)
+{
+    const uint64_t until = s_cycles + cycles;
+    for (uint64_t isr = next_interrupt(); isr <= until; isr = next_interrupt())
+    {
+        if (isr > s_cycles) s_cycles = isr;
+        service_interrupts();
+    }
+    if (until > s_cycles) s_cycles = until;
+    if (s_limit && (s_cycles > s_limit))
+    {
+        s_limit = 0; //do not throw again while unwinding
+        throw Timeout();
+    }
+}
+
+void advance_us(uint32_t us)
+{
+    advance(static_cast<uint64_t>(us) * (cpu_hz / 1000000));
+}
+
+void set_time_limit(double seconds)
+{
+    s_limit = (seconds > 0) ? (s_cycles + static_cast<uint64_t>(seconds * cpu_hz)) : 0;
+}
+
+void press(Button button, double seconds)
+{
+    s_button = button;
+    s_button_until = s_cycles + static_cast<uint64_t>(seconds * cpu_hz);
+}
+
+bool finda()
+{
+    const int8_t slot = selector_slot();
+    return (slot >= 0) && (s_tip[slot] >= 0);
+}
+
+float filament_mm(uint8_t slot)
+{
+    return (slot < EXTRUDERS) ? s_tip[slot] : 0;
+}
+
+int32_t axis_position(uint8_t axis)
+{
+    return s_pos[axis];
+}
+
+int8_t selector_slot()
+{
+    return nearest_slot(s_pos[AX_SEL], SELECTOR_STEPS_AFTER_HOMING, SELECTOR_STEPS, EXTRUDERS, SELECTOR_STEPS / 4.0f);
+}
+
+int8_t idler_slot()
+{
+    return nearest_slot(s_pos[AX_IDL], IDLER_STEPS_AFTER_HOMING, -IDLER_STEPS, EXTRUDERS, IDLER_STEPS / 5.0f);
+}
+
+bool watchdog_reset()
+{
+    return s_watchdog;
+}
+
+const Stats& stats()
+{
+    return s_stats;
+}
+
+void advance_io(uint32_t cycles)
+{
+    s_cycles += cycles;
+}
+
+uint8_t reg_read(RegId id)
+{
+    service_interrupts();
+    advance_io(io_cycles);
+    if (timer_register(id)) return timer_read(id);
+    switch (id)
+    {
+    case RegId::spsr:
+        return s_reg[static_cast<uint8_t>(id)] | ((s_spif && (s_cycles >= s_spi_done)) ? (1 << SPIF) : 0);
+    case RegId::spdr:
+        if (s_cycles >= s_spi_done) s_spif = false;
+        return s_spi_rx;
+    default:
+        return s_reg[static_cast<uint8_t>(id)];
+    }
+}
+
+void reg_write(RegId id, uint8_t value)
+{
+    advance_io(io_cycles);
+    if (timer_register(id))
+    {
+        timer_write(id, value);
+        service_interrupts();
+        return;
+    }
+    const uint8_t before = s_reg[static_cast<uint8_t>(id)];
+    s_reg[static_cast<uint8_t>(id)] = value;
+    switch (id)
+    {
+    case RegId::portb: port_b(before, value); break;
+    case RegId::portc: port_c(before, value); break;
+    case RegId::portd: port_d(before, value); break;
+    case RegId::spdr: spi_transfer(value); break;
+    default: break;
+    }
+    service_interrupts();
+}
+
+uint64_t spi_interrupt_at()
+{
+    const bool enabled = s_reg[static_cast<uint8_t>(RegId::spcr)] & (1 << SPIE);
+    return (enabled && s_spif) ? s_spi_done : UINT64_MAX;
+}
+
+void spi_interrupt_taken()
+{
+    s_spif = false;
+}
+
+void wdt_enable(uint8_t)
+{
+    s_watchdog = true;
+}
+
+namespace
+{
+
+int adc(uint8_t pin)
+{
+    advance(analog_read_cycles);
+    if (pin != A2) return 1023;
+    if (s_cycles >= s_button_until) s_button = Button::none;
+    switch (s_button)
+    {
+    case Button::right: return 0;
+    case Button::middle: return 90;
+    case Button::left: return 170;
+    default: return 1023;
+    }
+}
+
+uint8_t eeprom_read(uintptr_t addr)
+{
+    advance(eeprom_read_cycles);
+    return s_eeprom[addr % s_eeprom.size()];
+}
+
+void eeprom_update(uintptr_t addr, uint8_t value)
+{
+    advance(eeprom_read_cycles);
+    uint8_t &cell = s_eeprom[addr % s_eeprom.size()];
+    if (cell == value) return;
+    advance(eeprom_write_cycles);
+    cell = value;
+    ++s_stats.eeprom_writes;
+}
+
+} // unnamed namespace
+} // namespace sim
+
+using sim::advance;
+
+void pinMode(uint8_t, uint8_t)
+{
+    advance(sim::digital_read_cycles);
+}
+
+void digitalWrite(uint8_t, uint8_t)
+{
+    advance(sim::digital_read_cycles);
+}
+
+int digitalRead(uint8_t pin)
+{
+    advance(sim::digital_read_cycles);
+    if (pin == A1) return sim::finda() ? HIGH : LOW;
+    return LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+    return sim::adc(pin);
+}
+
+unsigned long millis(void)
+{
+    return static_cast<unsigned long>(sim::cycles() / (sim::cpu_hz / 1000));
+}
+
+unsigned long micros(void)
+{
+    return static_cast<unsigned long>(sim::cycles() / (sim::cpu_hz / 1000000));
+}
+
+void delay(unsigned long ms)
+{
+    for (; ms; --ms)
+    {
+        yield();
+        advance(sim::cpu_hz / 1000);
+    }
+}
+
+__attribute__((weak)) void yield(void)
+{
+}
+
+void delayMicroseconds(uint16_t us)
+{
+    sim::advance_us(us);
+}
+
+uint8_t eeprom_read_byte(const uint8_t* p)
+{
+    return sim::eeprom_read(reinterpret_cast<uintptr_t>(p));
+}
+
+uint16_t eeprom_read_word(const uint16_t* p)
+{
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+    return sim::eeprom_read(addr) | (sim::eeprom_read(addr + 1) << 8);
+}
+
+void eeprom_update_byte(uint8_t* p, uint8_t value)
+{
+    sim::eeprom_update(reinterpret_cast<uintptr_t>(p), value);
+}
+
+void eeprom_update_word(uint16_t* p, uint16_t value)
+{
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+    sim::eeprom_update(addr, value & 0xff);
+    sim::eeprom_update(addr + 1, value >> 8);
+}
+
+//! Buttons are read by analogRead(), ADC sequencer of adc.c is not simulated
+extern "C" void adc_init(void)
+{
+}
@@ -0,0 +1,158 @@
+//! @file
+//! @brief MMU board simulator
+//!
+//! Virtual clock, AVR peripherals, TMC2130 drivers, 16 bit shift register,
+//! selector, idler and pulley mechanics, FINDA and the printer end of the serial link.
+//!
+//! Virtual time advances only through Arduino delay and timing calls, I/O register
+//! accesses, SPI transfers, ADC conversions, EEPROM writes and serial traffic.
+//! Computation between them is free, so results are a lower bound of real cycle time
+//! dominated by the motion and I/O the firmware requests.
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include "phase.h"
+
+namespace sim
+{
+
+const uint32_t cpu_hz = 16000000;
+
+//! @brief Thrown from inside the firmware when virtual time passes set_time_limit()
+class Timeout : public std::runtime_error
+{
+public:
+    Timeout() : std::runtime_error("virtual time limit exceeded") {}
+};
+
+enum class Button : uint8_t
+{
+    none,
+    right,
+    middle,
+    left,
+};
+
+struct Options
+{
+    //! Printer sends 'A' when filament tip reaches the extruder gears (MK3S filament sensor).
+    bool printer_filament_sensor = false;
+    //! Selector position at power on, microsteps from its homing end stop (negative).
+    int32_t selector_start = -1500;
+    //! Idler position at power on, microsteps from its homing end stop (negative).
+    int32_t idler_start = -500;
+    //! Filament tips at power on, mm relative to FINDA trigger point (negative is behind it).
+    float filament_start_mm = -30.0f;
+    //! Filament tip has to be this far behind FINDA for selector to move freely.
+    //! Negative value uses half of FILAMENT_RETRACT_MM.
+    float selector_clear_mm = -1.0f;
+};
+
+struct AxisStats
+{
+    uint32_t steps;          //!< steps which moved the mechanics
+    uint32_t lost_steps;     //!< steps against an end stop, a jammed filament or on a de-energized motor
+    uint32_t min_interval;   //!< shortest time between two steps [us]
+    uint64_t last_step;      //!< time of last step [cycles]
+};
+
+struct Stats
+{
+    AxisStats axis[3];            //!< indexed by AX_PUL, AX_SEL, AX_IDL
+    uint32_t spi_bytes;
+    uint32_t spi_datagrams;
+    uint32_t shr16_writes;
+    uint32_t eeprom_writes;
+    uint32_t selector_violations; //!< selector steps taken with filament across selector
+    uint32_t filament_jams;       //!< pulley pushes into misaligned selector
+};
+
+struct PhaseStats
+{
+    uint32_t count;   //!< completed outermost occurrences
+    uint64_t cycles;  //!< total duration
+};
+
+void power_on(const Options& options = Options());
+//! @brief Save state surviving a reset of the MCU alone
+//!
+//! EEPROM, axis positions, filament tips and TMC2130 microstep counters.
+//! @retval false file could not be written
+bool save_state(const char* path);
+//! @brief Load state saved by save_state(), call after power_on() to simulate MCU reset
+//!
+//! Drivers stay powered, so they do not report reset in GSTAT.
+//! @retval false file could not be read
+bool load_state(const char* path);
+
+//! @brief Run firmware setup()
+//! @return startup message received on UART_COM, without line end
+std::string boot();
+//! @brief Send command line to UART_COM and run loop() until reply ending with "ok" arrives
+//! @param command command without line end
+//! @param reply received text without last line end
+//! @param limit simulated seconds to wait for reply
+//! @retval true reply received
+//! @retval false time limit exceeded
+bool run_command(const char* command, std::string& reply, double limit);
+//! @brief Send command as binary protocol frame on UART_COM and run loop() until its reply frame arrives
+//!
+//! Binary protocol has to be switched on by B1 before. Reply is given as in text protocol,
+//! "ok" or "<value>ok", "rejected" or "crc error" otherwise. Event frames are
+//! given as text protocol event lines preceding the reply.
+//! @param command command as text, e.g. T1 or F1 2, several commands separated by ','
+//!        are sent at once and their replies are given separated by ','.
+//! @param reply received text without last line end
+//! @param limit simulated seconds to wait for reply
+//! @retval true reply received
+//! @retval false time limit exceeded
+bool run_frame(const char* command, std::string& reply, double limit);
+//! @brief Run loop() for given simulated time without sending commands
+void run_idle(double seconds);
+
+uint64_t cycles();
+double seconds();
+void advance(uint64_t cycles);
+void advance_us(uint32_t us);
+//! @brief Throw Timeout once time passes now + seconds, 0 disables the limit
+void set_time_limit(double seconds);
+
+//! @brief Host side of serial port 0 (USB) or 1 (printer), bytes arrive at line rate
+void host_send(uint8_t port, const char* text);
+void host_send(uint8_t port, const std::string& data);
+//! @brief Bytes fully transmitted by the firmware since last call
+std::string host_receive(uint8_t port);
+uint32_t rx_overflows(uint8_t port);
+
+struct PollStats
+{
+    uint32_t sent;
+    uint32_t answered;
+    uint64_t max_latency; //!< longest time from query sent to reply received [cycles]
+};
+//! @brief Printer sends P0 on UART_COM every period simulated seconds, 0 stops
+//!
+//! Replies to the queries are taken out of host_receive() text and counted in poll_stats().
+void host_poll(double period);
+const PollStats& poll_stats();
+
+//! @brief Hold button from now on for given time
+void press(Button button, double seconds);
+
+bool finda();
+float filament_mm(uint8_t slot);
+int32_t axis_position(uint8_t axis);
+int8_t selector_slot();
+int8_t idler_slot();
+bool watchdog_reset();
+const Stats& stats();
+const PhaseStats& phase_stats(Phase phase);
+const char* phase_name(Phase phase);
+
+} // namespace sim
+
+#endif //SIM_H_
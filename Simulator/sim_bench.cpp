@@ -0,0 +1,112 @@
+//! @file
+//! @brief mmu-bench, tool change cycle time of one config-mmu-options profile
+//!
+//! Runs a fixed command script through the simulated firmware and reports
+//! simulated time per command and per tool change phase, and TMC2130 SPI
+//! traffic per tool change. The script changes
+//! through all slots in order, travels back to slot 0, unloads, loads to FINDA,
+//! ejects and recovers. The printer filament sensor is simulated.
+//!
+//! Fails when a command times out, or when a tool change moves the selector
+//! over filament or pushes filament into a misaligned selector.
+
+#include "sim.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "tmc2130.h"
+
+namespace
+{
+
+//! Firmware redirects stdout to a UART in setup()
+FILE* const s_out = stdout;
+const double command_limit = 300;
+
+std::vector<std::string> script()
+{
+    std::vector<std::string> commands;
+    for (uint8_t i = 0; i < EXTRUDERS; ++i)
+    {
+        commands.push_back("T" + std::to_string(i));
+        commands.push_back("C0");
+    }
+    commands.push_back("T0");
+    commands.push_back("C0");
+    commands.push_back("U0");
+    commands.push_back("L1");
+    commands.push_back("E1"); //eject moves selector over filament by design
+    commands.push_back("R0");
+    return commands;
+}
+
+uint32_t faults()
+{
+    return sim::stats().selector_violations + sim::stats().filament_jams;
+}
+
+} // unnamed namespace
+
+int main()
+{
+    sim::Options options;
+    options.printer_filament_sensor = true;
+    sim::power_on(options);
+    const std::string start_message = sim::boot();
+    fprintf(s_out, "profile %s, %d slots\n\n", MMU_PROFILE, EXTRUDERS);
+    fprintf(s_out, "%-8s %-8s %10s\n", "command", "reply", "time [s]");
+    fprintf(s_out, "%-8s %-8s %10.3f\n", "setup", start_message.c_str(), sim::seconds());
+
+    int result = 0;
+    uint8_t tool_changes = 0;
+    double tool_change_time = 0;
+    uint32_t tool_change_datagrams = 0;
+    uint32_t tool_change_skipped = 0;
+    const double start = sim::seconds();
+    for (const std::string &command : script())
+    {
+        const double command_start = sim::seconds();
+        const uint32_t faults_before = faults();
+        const uint32_t datagrams_before = sim::stats().spi_datagrams;
+        const uint16_t skipped_before = tmc2130_get_writes_skipped();
+        std::string reply;
+        const bool ok = sim::run_command(command.c_str(), reply, command_limit);
+        const double time = sim::seconds() - command_start;
+        fprintf(s_out, "%-8s %-8s %10.3f\n", command.c_str(), ok ? reply.c_str() : "timeout", time);
+        if (!ok)
+        {
+            result = 1;
+            break;
+        }
+        if (command[0] == 'T' || command[0] == 'C')
+        {
+            tool_change_time += time;
+            tool_change_datagrams += sim::stats().spi_datagrams - datagrams_before;
+            tool_change_skipped += tmc2130_get_writes_skipped() - skipped_before;
+            if (command[0] == 'T') ++tool_changes;
+        }
+        if ((command[0] != 'E') && (command[0] != 'R') && (faults() != faults_before))
+        {
+            fprintf(s_out, "%-8s selector moved over filament or filament jammed\n", command.c_str());
+            result = 1;
+        }
+    }
+
+    fprintf(s_out, "\n%-26s %6s %10s %10s\n", "phase", "count", "total [s]", "mean [s]");
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Phase::Count); ++i)
+    {
+        const Phase phase = static_cast<Phase>(i);
+        const sim::PhaseStats &ph = sim::phase_stats(phase);
+        const double total = static_cast<double>(ph.cycles) / sim::cpu_hz;
+        fprintf(s_out, "%-26s %6u %10.3f %10.3f\n", sim::phase_name(phase), ph.count, total,
+            ph.count ? (total / ph.count) : 0);
+    }
+
+    fprintf(s_out, "\nscript %.3f s, tool change with C0 %.3f s mean\n",
+        sim::seconds() - start, tool_changes ? (tool_change_time / tool_changes) : 0);
+    fprintf(s_out, "tool change with C0 %.1f SPI datagrams, %.1f TMC2130 writes skipped mean\n",
+        tool_changes ? (static_cast<double>(tool_change_datagrams) / tool_changes) : 0,
+        tool_changes ? (static_cast<double>(tool_change_skipped) / tool_changes) : 0);
+    return result;
+}
@@ -0,0 +1,38 @@
+//! @file
+//! @brief Interfaces between parts of the simulator, not used by the firmware
+
+#ifndef SIM_INTERNAL_H_
+#define SIM_INTERNAL_H_
+
+#include <stdint.h>
+#include <avr/io.h>
+
+namespace sim
+{
+
+void uart_reset();
+void phase_reset();
+void timer_reset();
+
+//! @brief Advance time of an I/O register access, interrupts are not serviced
+void advance_io(uint32_t cycles);
+
+bool timer_register(RegId id);
+uint8_t timer_read(RegId id);
+void timer_write(RegId id, uint8_t value);
+uint16_t timer_read16(RegId low);
+void timer_write16(RegId low, uint16_t value);
+
+//! @brief Cycle SPI transfer complete interrupt is due at, UINT64_MAX when not enabled or no transfer
+uint64_t spi_interrupt_at();
+//! @brief SPI interrupt routine is entered, hardware clears SPIF
+void spi_interrupt_taken();
+
+//! @brief Cycle an interrupt routine is due at, UINT64_MAX when none can run
+uint64_t next_interrupt();
+//! @brief Run due interrupt routines
+void service_interrupts();
+
+} // namespace sim
+
+#endif //SIM_INTERNAL_H_
@@ -0,0 +1,134 @@
+//! @file
+//! @brief mmu-sim, runs printer commands against the simulated MMU
+//!
+//! usage: mmu-sim [--sensor] [--limit <s>] [--console] [--state <file>] [--poll <s>] [--binary] <command>...
+//!
+//! Each command is sent to the firmware as a line on UART_COM, e.g. T0 or U0.
+//! Prints the reply and the simulated time the command took, progress events
+//! enabled by N1 are listed below the command. Command +<s>
+//! runs the firmware idle for given simulated seconds.
+//!
+//! --state loads EEPROM, mechanics and driver microstep counters from file if it
+//! exists and saves them at exit, so consecutive runs simulate MCU resets.
+//!
+//! --poll makes the printer query FINDA with P0 at given period while a command
+//! runs, number of answered queries and longest reply time are reported.
+//!
+//! --binary switches the printer link to binary protocol by B1 after start and
+//! sends the commands as frames.
+
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+
+namespace
+{
+
+//! Firmware redirects stdout to a UART in setup()
+FILE* const s_out = stdout;
+double s_limit = 600;
+bool s_console = false;
+const char* s_state = nullptr;
+double s_poll = 0;
+bool s_binary = false;
+
+void print_console()
+{
+    if (!s_console || UART_COM == 0) return;
+    std::string console = sim::host_receive(0);
+    while (!console.empty() && console.back() == '\n') console.pop_back();
+    if (!console.empty()) fprintf(s_out, "  console: %s\n", console.c_str());
+}
+
+//! @brief Move progress event lines (N1) out of reply
+//! @return indented event lines
+std::string take_events(std::string& reply)
+{
+    std::string events;
+    std::string rest;
+    size_t begin = 0;
+    while (begin < reply.size())
+    {
+        size_t end = reply.find('\n', begin);
+        if (end == std::string::npos) end = reply.size();
+        const std::string line = reply.substr(begin, end - begin);
+        if (!line.empty() && line[0] == '#') events += "  event: " + line + "\n";
+        else rest += (rest.empty() ? "" : "\n") + line;
+        begin = end + 1;
+    }
+    reply = rest;
+    return events;
+}
+
+} // unnamed namespace
+
+int main(int argc, char** argv)
+{
+    sim::Options options;
+    int arg = 1;
+    for (; arg < argc && !strncmp(argv[arg], "--", 2); ++arg)
+    {
+        if (!strcmp(argv[arg], "--sensor")) options.printer_filament_sensor = true;
+        else if (!strcmp(argv[arg], "--console")) s_console = true;
+        else if (!strcmp(argv[arg], "--limit") && arg + 1 < argc) s_limit = atof(argv[++arg]);
+        else if (!strcmp(argv[arg], "--state") && arg + 1 < argc) s_state = argv[++arg];
+        else if (!strcmp(argv[arg], "--poll") && arg + 1 < argc) s_poll = atof(argv[++arg]);
+        else if (!strcmp(argv[arg], "--binary")) s_binary = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--sensor] [--limit <s>] [--console] [--state <file>] [--poll <s>] [--binary] <command>...\n", argv[0]);
+            return 2;
+        }
+    }
+
+    sim::power_on(options);
+    if (s_state) sim::load_state(s_state);
+    std::string reply = sim::boot();
+    fprintf(s_out, "%-8s %-10s %10.3f s\n", "setup", reply.c_str(), sim::seconds());
+    print_console();
+
+    int result = 0;
+    if (s_binary && !sim::run_command("B1", reply, s_limit))
+    {
+        fprintf(stderr, "binary protocol not accepted\n");
+        return 1;
+    }
+    for (; arg < argc; ++arg)
+    {
+        const double start = sim::seconds();
+        if (argv[arg][0] == '+')
+        {
+            sim::run_idle(atof(argv[arg] + 1));
+            fprintf(s_out, "%-8s %-10s %10.3f s\n", argv[arg], "idle", sim::seconds() - start);
+            print_console();
+            continue;
+        }
+        sim::host_poll(s_poll);
+        const bool ok = s_binary ? sim::run_frame(argv[arg], reply, s_limit) : sim::run_command(argv[arg], reply, s_limit);
+        sim::host_poll(0);
+        const std::string events = take_events(reply);
+        fprintf(s_out, "%-8s %-10s %10.3f s\n", argv[arg], ok ? reply.c_str() : "timeout", sim::seconds() - start);
+        if (!events.empty()) fputs(events.c_str(), s_out);
+        print_console();
+        if (!ok)
+        {
+            result = 1;
+            break;
+        }
+    }
+
+    if (s_state && !sim::save_state(s_state)) fprintf(stderr, "cannot write %s\n", s_state);
+    const sim::Stats &st = sim::stats();
+    fprintf(s_out, "total %.3f s, selector violations %u, filament jams %u, lost steps %u/%u/%u\n",
+        sim::seconds(), st.selector_violations, st.filament_jams,
+        st.axis[AX_PUL].lost_steps, st.axis[AX_SEL].lost_steps, st.axis[AX_IDL].lost_steps);
+    if (s_poll > 0)
+    {
+        const sim::PollStats &poll = sim::poll_stats();
+        fprintf(s_out, "polls answered %u/%u, longest reply %.3f ms\n",
+            poll.answered, poll.sent, poll.max_latency * 1000.0 / sim::cpu_hz);
+    }
+    return result;
+}
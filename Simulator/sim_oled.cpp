@@ -0,0 +1,55 @@
+//! @file
+//! @brief Simulated OLED display, costs I2C bus time only
+
+#include "sim.h"
+#include <SSD1306AsciiWire.h>
+
+TwoWire Wire;
+
+namespace
+{
+
+const uint8_t oled_width = 128;
+const uint8_t oled_pages = 8;
+
+} // unnamed namespace
+
+void SSD1306Ascii::transfer(uint16_t bytes)
+{
+    //address and control byte per transaction, 9 clocks per byte including ACK
+    sim::advance(static_cast<uint64_t>(bytes + 2) * 9 * sim::cpu_hz / Wire.getClock());
+}
+
+void SSD1306Ascii::clear()
+{
+    transfer(oled_width * oled_pages);
+    m_col = 0;
+    m_row = 0;
+}
+
+void SSD1306Ascii::setCursor(uint8_t col, uint8_t row)
+{
+    transfer(3);
+    m_col = col;
+    m_row = row;
+}
+
+size_t SSD1306Ascii::strWidth(const char* str) const
+{
+    return strlen(str) * (fontWidth() + 1);
+}
+
+size_t SSD1306Ascii::write(uint8_t c)
+{
+    (void)c;
+    transfer((fontWidth() + 1) * fontRows());
+    m_col += fontWidth() + 1;
+    return 1;
+}
+
+size_t SSD1306Ascii::write(const char* str)
+{
+    size_t n = 0;
+    for (; *str; ++str) n += write(static_cast<uint8_t>(*str));
+    return n;
+}
@@ -0,0 +1,203 @@
+//! @file
+//! @brief Running the firmware and phase accounting
+
+#include "sim.h"
+#include <stdlib.h>
+#include <vector>
+#include "config.h"
+
+void setup();
+void loop();
+
+namespace sim
+{
+namespace
+{
+
+const char* const s_phase_name[] =
+{
+    "unload_to_finda",
+    "retract_filament",
+    "motion_set_idler_selector",
+    "load_filament_withSensor",
+    "motion_feed_to_bondtech",
+    "home_idler",
+    "home_selector",
+};
+static_assert(sizeof(s_phase_name) / sizeof(s_phase_name[0]) == static_cast<uint8_t>(Phase::Count), "phase name missing");
+
+PhaseStats s_phase[static_cast<uint8_t>(Phase::Count)];
+uint64_t s_phase_start[static_cast<uint8_t>(Phase::Count)];
+uint8_t s_phase_depth[static_cast<uint8_t>(Phase::Count)];
+
+const uint8_t frame_start = 0xa5;
+
+uint8_t crc8(uint8_t crc, uint8_t data)
+{
+    crc ^= data;
+    for (uint8_t i = 0; i < 8; ++i) crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    return crc;
+}
+
+//! @brief Frame with CRC, payload is little endian int16 values
+std::string frame(uint8_t seq, char op, const std::vector<int16_t>& values)
+{
+    std::string data(1, static_cast<char>(frame_start));
+    data += static_cast<char>(values.size() * 2);
+    data += static_cast<char>(seq);
+    data += op;
+    for (const int16_t v : values)
+    {
+        data += static_cast<char>(v & 0xff);
+        data += static_cast<char>((v >> 8) & 0xff);
+    }
+    uint8_t crc = 0;
+    for (size_t i = 1; i < data.size(); ++i) crc = crc8(crc, data[i]);
+    return data + static_cast<char>(crc);
+}
+
+std::string chomp(std::string text)
+{
+    while (!text.empty() && text.back() == '\n') text.pop_back();
+    return text;
+}
+
+} // unnamed namespace
+
+void phase_reset()
+{
+    for (uint8_t i = 0; i < static_cast<uint8_t>(Phase::Count); ++i)
+    {
+        s_phase[i] = PhaseStats();
+        s_phase_depth[i] = 0;
+    }
+}
+
+const PhaseStats& phase_stats(Phase phase)
+{
+    return s_phase[static_cast<uint8_t>(phase)];
+}
+
+const char* phase_name(Phase phase)
+{
+    return s_phase_name[static_cast<uint8_t>(phase)];
+}
+
+std::string boot()
+{
+    setup();
+    return chomp(host_receive(UART_COM));
+}
+
+bool run_command(const char* command, std::string& reply, double limit)
+{
+    host_send(UART_COM, command);
+    host_send(UART_COM, "\n");
+    reply.clear();
+    set_time_limit(limit);
+    try
+    {
+        while (reply.size() < 3 || reply.compare(reply.size() - 3, 3, "ok\n"))
+        {
+            loop();
+            reply += host_receive(UART_COM);
+        }
+    }
+    catch (const Timeout&)
+    {
+        reply = chomp(reply);
+        return false;
+    }
+    set_time_limit(0);
+    reply = chomp(reply);
+    return true;
+}
+
+bool run_frame(const char* command, std::string& reply, double limit)
+{
+    static uint8_t s_seq = 0;
+    std::vector<uint8_t> seqs;
+    std::string data;
+    for (const char* c = command; *c;)
+    {
+        const char op = *c++;
+        std::vector<int16_t> values;
+        while (*c && (*c != ','))
+        {
+            char* end;
+            values.push_back(static_cast<int16_t>(strtol(c, &end, 10)));
+            if (end == c) break;
+            c = end;
+        }
+        if (*c == ',') ++c;
+        seqs.push_back(++s_seq);
+        data += frame(seqs.back(), op, values);
+    }
+    host_send(UART_COM, data);
+
+    reply.clear();
+    std::vector<std::string> replies(seqs.size());
+    size_t replied = 0;
+    std::string received;
+    set_time_limit(limit);
+    try
+    {
+        while (replied < seqs.size())
+        {
+            loop();
+            received += host_receive(UART_COM);
+            size_t start;
+            while ((start = received.find(static_cast<char>(frame_start))) != std::string::npos)
+            {
+                received.erase(0, start);
+                if ((received.size() < 5) || (received.size() < 5u + static_cast<uint8_t>(received[1]))) break;
+                const uint8_t length = received[1];
+                const uint8_t seq = received[2];
+                const uint8_t op = received[3];
+                const std::string payload = received.substr(4, length);
+                received.erase(0, 5 + length);
+                if (op == '#') reply += "#" + payload + "\n";
+                if ((op >= 'a') && (op <= 'z')) continue; //accepted
+                for (size_t i = 0; i < seqs.size(); ++i)
+                {
+                    if ((seqs[i] != seq) || !replies[i].empty()) continue;
+                    if (op == 0) replies[i] = "crc error";
+                    else if (op & 0x80) replies[i] = "rejected";
+                    else if (length >= 2) replies[i] = std::to_string(static_cast<int16_t>(static_cast<uint8_t>(payload[0]) | (payload[1] << 8))) + "ok";
+                    else replies[i] = "ok";
+                    ++replied;
+                }
+            }
+        }
+    }
+    catch (const Timeout&)
+    {
+        reply = chomp(reply);
+        return false;
+    }
+    set_time_limit(0);
+    for (size_t i = 0; i < replies.size(); ++i) reply += (i ? "," : "") + replies[i];
+    return true;
+}
+
+void run_idle(double seconds)
+{
+    const uint64_t until = cycles() + static_cast<uint64_t>(seconds * cpu_hz);
+    while (cycles() < until) loop();
+}
+
+} // namespace sim
+
+void phase_begin(Phase phase)
+{
+    const uint8_t i = static_cast<uint8_t>(phase);
+    if (!sim::s_phase_depth[i]++) sim::s_phase_start[i] = sim::cycles();
+}
+
+void phase_end(Phase phase)
+{
+    const uint8_t i = static_cast<uint8_t>(phase);
+    if (--sim::s_phase_depth[i]) return;
+    ++sim::s_phase[i].count;
+    sim::s_phase[i].cycles += sim::cycles() - sim::s_phase_start[i];
+}
@@ -0,0 +1,253 @@
+//! @file
+//! @brief Simulated Timer1 in CTC mode and interrupt dispatch
+//!
+//! Timer1 compare match has priority over SPI transfer complete, as on the AVR.
+
+#include "sim.h"
+#include "sim_internal.h"
+
+extern "C" void sim_timer1_compa_vect(void) __attribute__((weak));
+extern "C" void sim_spi_stc_vect(void) __attribute__((weak));
+
+namespace sim
+{
+namespace
+{
+
+const uint32_t isr_cycles = 40;         //!< vector, prologue, epilogue and RETI
+const uint32_t timer0_overflow = 16384; //!< Arduino millis() interrupt wakes the CPU from sleep
+
+bool s_sreg_i;
+bool s_in_isr;
+
+uint8_t s_tccr1a;
+uint8_t s_tccr1b;
+uint8_t s_timsk1;
+uint8_t s_tifr1;
+uint16_t s_ocr1a;
+uint16_t s_tcnt1;        //!< counter while stopped
+uint64_t s_base;         //!< cycle the counter was 0
+uint64_t s_match;        //!< cycle of next compare match
+
+uint32_t prescaler()
+{
+    static const uint16_t divider[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return divider[s_tccr1b & 7];
+}
+
+uint16_t counter()
+{
+    const uint32_t p = prescaler();
+    return p ? static_cast<uint16_t>((cycles() - s_base) / p) : s_tcnt1;
+}
+
+//! @brief Next time counter equals OCR1A, wraps through 0xffff when it is already above
+void schedule()
+{
+    const uint32_t p = prescaler();
+    if (!p) return;
+    if (counter() > s_ocr1a) s_base += 0x10000ull * p;
+    s_match = s_base + (s_ocr1a + 1ull) * p;
+}
+
+bool interruptible()
+{
+    return s_sreg_i && !s_in_isr;
+}
+
+bool dispatchable()
+{
+    return interruptible() && (s_timsk1 & (1 << OCIE1A)) && sim_timer1_compa_vect;
+}
+
+bool spi_dispatchable()
+{
+    return interruptible() && sim_spi_stc_vect;
+}
+
+//! @brief Interrupt routine runs with interrupts disabled
+class IsrContext
+{
+public:
+    IsrContext() { s_in_isr = true; s_sreg_i = false; advance_io(isr_cycles); }
+    ~IsrContext() { s_in_isr = false; s_sreg_i = true; }
+};
+
+} // unnamed namespace
+
+void timer_reset()
+{
+    s_sreg_i = true; //Arduino core enables interrupts before setup()
+    s_in_isr = false;
+    s_tccr1a = 0;
+    s_tccr1b = 0;
+    s_timsk1 = 0;
+    s_tifr1 = 0;
+    s_ocr1a = 0;
+    s_tcnt1 = 0;
+    s_base = 0;
+    s_match = 0;
+}
+
+bool timer_register(RegId id)
+{
+    switch (id)
+    {
+    case RegId::tccr1a: case RegId::tccr1b: case RegId::tccr1c:
+    case RegId::timsk1: case RegId::tifr1:
+    case RegId::tcnt1l: case RegId::tcnt1h: case RegId::ocr1al: case RegId::ocr1ah:
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint8_t timer_read(RegId id)
+{
+    switch (id)
+    {
+    case RegId::tccr1a: return s_tccr1a;
+    case RegId::tccr1b: return s_tccr1b;
+    case RegId::timsk1: return s_timsk1;
+    case RegId::tifr1: return s_tifr1;
+    case RegId::tcnt1l: return counter();
+    case RegId::tcnt1h: return counter() >> 8;
+    case RegId::ocr1al: return s_ocr1a;
+    case RegId::ocr1ah: return s_ocr1a >> 8;
+    default: return 0;
+    }
+}
+
+void timer_write(RegId id, uint8_t value)
+{
+    switch (id)
+    {
+    case RegId::tccr1a:
+        s_tccr1a = value;
+        break;
+    case RegId::tccr1b:
+    {
+        const uint16_t count = counter();
+        s_tccr1b = value;
+        s_tcnt1 = count;
+        s_base = cycles() - static_cast<uint64_t>(count) * prescaler();
+        schedule();
+        break;
+    }
+    case RegId::timsk1:
+        s_timsk1 = value;
+        break;
+    case RegId::tifr1:
+        s_tifr1 &= ~value; //writing one clears flag
+        break;
+    case RegId::tcnt1l:
+        timer_write16(id, (counter() & 0xff00) | value);
+        break;
+    case RegId::ocr1al:
+        timer_write16(id, (s_ocr1a & 0xff00) | value);
+        break;
+    default:
+        break;
+    }
+}
+
+uint16_t timer_read16(RegId low)
+{
+    return (low == RegId::tcnt1l) ? counter() : s_ocr1a;
+}
+
+void timer_write16(RegId low, uint16_t value)
+{
+    if (low == RegId::tcnt1l)
+    {
+        s_tcnt1 = value;
+        s_base = cycles() - static_cast<uint64_t>(value) * prescaler();
+    }
+    else s_ocr1a = value;
+    schedule();
+}
+
+uint64_t next_interrupt()
+{
+    uint64_t next = UINT64_MAX;
+    if (dispatchable())
+    {
+        if (s_tifr1 & (1 << OCF1A)) return cycles();
+        if (prescaler()) next = s_match;
+    }
+    if (spi_dispatchable())
+    {
+        const uint64_t spi = spi_interrupt_at();
+        if (spi < next) next = spi;
+    }
+    return next;
+}
+
+void service_interrupts()
+{
+    while (true)
+    {
+        const uint32_t p = prescaler();
+        if (p && (s_match <= cycles()))
+        {
+            const uint64_t period = (s_ocr1a + 1ull) * p;
+            const uint64_t missed = dispatchable() ? 0 : (cycles() - s_match) / period;
+            s_base = s_match + missed * period;
+            s_match = s_base + period;
+            s_tifr1 |= (1 << OCF1A);
+        }
+        if (dispatchable() && (s_tifr1 & (1 << OCF1A)))
+        {
+            s_tifr1 &= ~(1 << OCF1A);
+            IsrContext context;
+            sim_timer1_compa_vect();
+        }
+        else if (spi_dispatchable() && (spi_interrupt_at() <= cycles()))
+        {
+            spi_interrupt_taken();
+            IsrContext context;
+            sim_spi_stc_vect();
+        }
+        else return;
+    }
+}
+
+void sei()
+{
+    s_sreg_i = true;
+    service_interrupts();
+}
+
+void cli()
+{
+    s_sreg_i = false;
+}
+
+//! Idle sleep ends with the next interrupt, Timer0 overflow at the latest.
+void sleep_cpu()
+{
+    const uint64_t now = cycles();
+    uint64_t wake = now + timer0_overflow - (now % timer0_overflow);
+    const uint64_t isr = next_interrupt();
+    if (isr < wake) wake = isr;
+    if (wake > now) advance(wake - now);
+    else service_interrupts();
+}
+
+Reg16::operator uint16_t() const
+{
+    service_interrupts();
+    const uint16_t value = timer_read16(m_low);
+    advance_io(4);
+    return value;
+}
+
+const Reg16& Reg16::operator=(uint16_t value) const
+{
+    advance_io(4);
+    timer_write16(m_low, value);
+    service_interrupts();
+    return *this;
+}
+
+} // namespace sim
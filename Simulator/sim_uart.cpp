@@ -0,0 +1,334 @@
+//! @file
+//! @brief Simulated UARTs and the stdio streams of uart.h
+//!
+//! Bytes travel at the configured line rate in both directions. Transmit
+//! blocks the firmware once the transmit buffer is full, received bytes
+//! are dropped once the receive ring buffer is full, as on the real board.
+//! UART1 receive interrupt takes printer 'A' out, see uart1_rx_token().
+
+#include "sim.h"
+#include <deque>
+#include <errno.h>
+#include <Arduino.h>
+#include "uart.h"
+#include "config.h"
+
+namespace sim
+{
+namespace
+{
+
+const uint32_t serial_call_cycles = 40;
+const uint32_t usb_byte_cycles = 250; //!< USB CDC, not limited by baud rate
+const size_t tx_buffer_size = 64;     //!< USB CDC endpoint
+const size_t rx_buffer_size = 63;     //!< one slot of Arduino ring buffer stays free
+
+struct TimedByte
+{
+    uint8_t c;
+    uint64_t at; //!< cycle the last bit leaves or arrives
+};
+
+struct Port
+{
+    uint32_t byte_cycles = usb_byte_cycles;
+    size_t rx_size = rx_buffer_size;  //!< bytes receive buffer holds
+    size_t tx_size = tx_buffer_size;  //!< bytes transmit buffer and shift register hold
+    std::deque<TimedByte> line;  //!< host to firmware, not yet received
+    std::deque<uint8_t> rx;      //!< firmware receive buffer
+    std::deque<TimedByte> tx;    //!< firmware transmit buffer and shift register
+    std::string host;            //!< received by host
+    uint32_t overflows = 0;
+    uint8_t token = 0;           //!< uart1_rx_token() state
+};
+
+Port s_port[2];
+bool s_filament_sensed = false; //!< UART1 received printer 'A'
+
+//! @brief Printer polling FINDA with P0 on UART_COM
+struct Poll
+{
+    uint64_t period = 0;          //!< 0 disabled [cycles]
+    uint64_t next = 0;            //!< next query is sent [cycles]
+    std::deque<uint64_t> sent;    //!< send time of unanswered queries [cycles]
+    std::string line;             //!< reply line received so far
+    PollStats stats;
+};
+
+Poll s_poll;
+
+//! @brief Send queries due before now
+void poll_send(Port &p)
+{
+    if (!s_poll.period) return;
+    while (s_poll.next <= cycles())
+    {
+        uint64_t at = (p.line.empty() || (p.line.back().at < s_poll.next)) ? s_poll.next : p.line.back().at;
+        for (const char* c = "P0\n"; *c; ++c)
+        {
+            at += p.byte_cycles;
+            p.line.push_back({static_cast<uint8_t>(*c), at});
+        }
+        s_poll.sent.push_back(s_poll.next);
+        ++s_poll.stats.sent;
+        s_poll.next += s_poll.period;
+    }
+}
+
+//! @brief Pass transmitted byte to host, take out replies to queries
+void poll_receive(Port &p, const TimedByte &b)
+{
+    if (s_poll.sent.empty())
+    {
+        p.host.push_back(b.c);
+        return;
+    }
+    s_poll.line.push_back(b.c);
+    if (b.c != '\n') return;
+    if ((s_poll.line.size() == 4) && (s_poll.line[0] == '0' || s_poll.line[0] == '1') && !s_poll.line.compare(1, 3, "ok\n"))
+    {
+        const uint64_t latency = b.at - s_poll.sent.front();
+        s_poll.sent.pop_front();
+        ++s_poll.stats.answered;
+        if (latency > s_poll.stats.max_latency) s_poll.stats.max_latency = latency;
+    }
+    else p.host += s_poll.line;
+    s_poll.line.clear();
+}
+
+void receive(Port &p)
+{
+    if (&p == &s_port[UART_COM]) poll_send(p);
+    while (!p.line.empty() && (p.line.front().at <= cycles()))
+    {
+        const uint8_t c = p.line.front().c;
+        if ((&p == &s_port[1]) && uart1_rx_token(c, p.token)) s_filament_sensed = true;
+        else if (p.rx.size() < p.rx_size) p.rx.push_back(c);
+        else ++p.overflows;
+        p.line.pop_front();
+    }
+}
+
+void transmit(Port &p)
+{
+    while (!p.tx.empty() && (p.tx.front().at <= cycles()))
+    {
+        if (&p == &s_port[UART_COM]) poll_receive(p, p.tx.front());
+        else p.host.push_back(p.tx.front().c);
+        p.tx.pop_front();
+    }
+}
+
+Port &port(uint8_t n)
+{
+    Port &p = s_port[n & 1];
+    receive(p);
+    transmit(p);
+    return p;
+}
+
+} // unnamed namespace
+
+void host_send(uint8_t n, const char* text)
+{
+    host_send(n, std::string(text));
+}
+
+void host_send(uint8_t n, const std::string& data)
+{
+    Port &p = port(n);
+    uint64_t at = p.line.empty() ? cycles() : p.line.back().at;
+    for (const char c : data)
+    {
+        at += p.byte_cycles;
+        p.line.push_back({static_cast<uint8_t>(c), at});
+    }
+}
+
+std::string host_receive(uint8_t n)
+{
+    Port &p = port(n);
+    std::string received;
+    received.swap(p.host);
+    return received;
+}
+
+uint32_t rx_overflows(uint8_t n)
+{
+    return port(n).overflows;
+}
+
+void host_poll(double period)
+{
+    port(UART_COM);
+    s_poll.period = static_cast<uint64_t>(period * cpu_hz);
+    s_poll.next = cycles() + s_poll.period;
+}
+
+const PollStats& poll_stats()
+{
+    return s_poll.stats;
+}
+
+void uart_reset()
+{
+    for (Port &p : s_port) p = Port();
+    s_filament_sensed = false;
+    s_poll = Poll();
+}
+
+} // namespace sim
+
+void HardwareSerial::begin(unsigned long baud, uint8_t config)
+{
+    const uint8_t bits = 1 + 8 + ((config == SERIAL_8N2) ? 2 : 1);
+    sim::Port &p = sim::port(m_port);
+    //port 0 is USB CDC, baud rate is ignored
+    p.byte_cycles = m_port ? (sim::cpu_hz * bits / baud) : sim::usb_byte_cycles;
+    if (m_port)
+    {
+        //uart.cpp ring buffers keep one slot free, transmit has the shift register in addition
+        p.rx_size = UART1_RX_BUFFER_SIZE - 1;
+        p.tx_size = UART1_TX_BUFFER_SIZE;
+    }
+}
+
+int HardwareSerial::available(void)
+{
+    sim::advance(sim::serial_call_cycles);
+    return sim::port(m_port).rx.size();
+}
+
+int HardwareSerial::peek(void)
+{
+    sim::advance(sim::serial_call_cycles);
+    sim::Port &p = sim::port(m_port);
+    return p.rx.empty() ? -1 : p.rx.front();
+}
+
+int HardwareSerial::read(void)
+{
+    sim::advance(sim::serial_call_cycles);
+    sim::Port &p = sim::port(m_port);
+    if (p.rx.empty()) return -1;
+    const uint8_t c = p.rx.front();
+    p.rx.pop_front();
+    return c;
+}
+
+int HardwareSerial::availableForWrite(void)
+{
+    sim::advance(sim::serial_call_cycles);
+    sim::Port &p = sim::port(m_port);
+    return p.tx_size - p.tx.size();
+}
+
+void HardwareSerial::flush(void)
+{
+    sim::Port &p = sim::port(m_port);
+    if (!p.tx.empty()) sim::advance(p.tx.back().at - sim::cycles());
+    sim::port(m_port);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    sim::advance(sim::serial_call_cycles);
+    sim::Port &p = sim::port(m_port);
+    if (p.tx.size() >= p.tx_size)
+    {
+        sim::advance(p.tx.front().at - sim::cycles());
+        sim::port(m_port);
+    }
+    const uint64_t start = p.tx.empty() ? sim::cycles() : p.tx.back().at;
+    p.tx.push_back({c, start + p.byte_cycles});
+    return 1;
+}
+
+size_t HardwareSerial::write(const char* str)
+{
+    size_t n = 0;
+    for (; *str; ++str) n += write(static_cast<uint8_t>(*str));
+    return n;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) write(buffer[i]);
+    return size;
+}
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+
+namespace
+{
+
+ssize_t stream_write(void* cookie, const char* buf, size_t size)
+{
+    HardwareSerial &serial = *static_cast<HardwareSerial*>(cookie);
+    for (size_t i = 0; i < size; ++i) serial.write(static_cast<uint8_t>(buf[i]));
+    return size;
+}
+
+//! Returning 0 would latch end of file, report "no data yet" instead.
+ssize_t stream_read(void* cookie, char* buf, size_t size)
+{
+    HardwareSerial &serial = *static_cast<HardwareSerial*>(cookie);
+    if (!size) return 0;
+    const int c = serial.read();
+    if (c < 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    buf[0] = static_cast<char>(c);
+    return 1;
+}
+
+FILE* open_stream(HardwareSerial &serial)
+{
+    cookie_io_functions_t io = {stream_read, stream_write, nullptr, nullptr};
+    FILE* stream = fopencookie(&serial, "r+", io);
+    setvbuf(stream, nullptr, _IONBF, 0);
+    return stream;
+}
+
+//! @brief Opens streams before firmware globals (uart_com) are initialized
+struct Streams
+{
+    Streams()
+    {
+        sim_uart0io = open_stream(Serial);
+        sim_uart1io = open_stream(Serial1);
+    }
+} s_streams __attribute__((init_priority(101)));
+
+} // unnamed namespace
+
+FILE* sim_uart0io;
+FILE* sim_uart1io;
+
+void uart0_init(void)
+{
+    Serial.begin(UART0_BDR, SERIAL_8N2); //serial0 - USB
+}
+
+void uart1_init(void)
+{
+    Serial1.begin(UART1_BDR, SERIAL_8N2); //serial1
+}
+
+bool uart1_take_filament_sensed(void)
+{
+    sim::port(1);
+    if (!sim::s_filament_sensed) return false;
+    sim::s_filament_sensed = false;
+    return true;
+}
+
+//! Simulated line has no framing nor parity errors.
+uint16_t uart1_error_count(uint8_t error)
+{
+    const uint32_t count = (error == UART1_ERR_OVERFLOW) ? sim::port(1).overflows : 0;
+    return (count < UINT16_MAX) ? count : UINT16_MAX;
+}
@@ -7,10 +7,12 @@
 #include "../MM-control-01/permanent_storage.h"
 #include <avr/eeprom.h>
 #include <cstddef>
+#include <array>
 
 int active_extruder = -1;
 static unsigned long writes = 0;
 static int corrupt = -1;
+static int drop = -1;
 
 static std::array<uint8_t, 1024> eeprom;
 static const std::array<uint8_t, 1024> eeprom_empty =
@@ -695,6 +697,11 @@ uint8_t eeprom_read_byte( const uint8_t * __p)
 void eeprom_update_byte( uint8_t * __p, uint8_t __value)
 {
     size_t index = reinterpret_cast<size_t>(__p);
+    if (index == drop)
+    {
+        drop = -1;
+        return;
+    }
     if (eeprom[index] != __value) ++writes;
     eeprom[index] = __value;
     if (index == corrupt)  eeprom[index] = 0xab;
@@ -827,3 +834,72 @@ TEST_CASE( "Set and get filament.", "[permanent_storage]" )
     CHECK(3212 == writes);
 
 }
+
+TEST_CASE( "Set, get and invalidate homed position.", "[permanent_storage]" )
+{
+    eepromEraseAll();
+    writes = 0;
+    HomedPosition::Position position = {0xf, 0xf, 0, 0};
+
+    CHECK(false == HomedPosition::get(position));
+    HomedPosition::invalidate();
+    CHECK(0 == writes);
+
+    CHECK(true == HomedPosition::set({1, 2, 512, 1020}));
+    CHECK(true == HomedPosition::get(position));
+    CHECK(1 == position.idler);
+    CHECK(2 == position.selector);
+    CHECK(512 == position.idlerMscnt);
+    CHECK(1020 == position.selectorMscnt);
+
+    HomedPosition::invalidate();
+    CHECK(false == HomedPosition::get(position));
+    HomedPosition::invalidate();
+    CHECK(false == HomedPosition::get(position));
+
+    for(uint8_t i = 0; i < 200; ++i)
+    {
+        CHECK(true == HomedPosition::set({static_cast<uint8_t>(i % 5), static_cast<uint8_t>(i % 6), static_cast<uint16_t>(i * 4), 0}));
+        CHECK(true == HomedPosition::get(position));
+        CHECK(i % 5 == position.idler);
+        CHECK(i % 6 == position.selector);
+        CHECK(i * 4 == position.idlerMscnt);
+        CHECK(0 == position.selectorMscnt);
+        HomedPosition::invalidate();
+        CHECK(false == HomedPosition::get(position));
+    }
+
+    permanentStorageInit();
+    CHECK(true == HomedPosition::set({4, 3, 8, 12}));
+    eeprom_update_byte(reinterpret_cast<uint8_t*>(E2END), 0x1);
+    permanentStorageInit();
+    CHECK(false == HomedPosition::get(position));
+
+    eepromEraseAll();
+    writes = 0;
+}
+
+TEST_CASE( "Homed position is not restored from records of earlier key.", "[permanent_storage]" )
+{
+    eepromEraseAll();
+    HomedPosition::Position position = {0xf, 0xf, 0, 0};
+
+    for(uint8_t i = 0; i < 6; ++i)
+    {
+        CHECK(true == HomedPosition::set({i, i, 0, 0}));
+    }
+    // first key switch, record 6 key byte is corrupted
+    corrupt = 844;
+    CHECK(true == HomedPosition::set({6, 6, 0, 0}));
+    corrupt = -1;
+    // second key switch, record 1 keeps first key as its key byte write is lost
+    drop = 824;
+    CHECK(true == HomedPosition::set({7, 7, 0, 0}));
+    CHECK(-1 == drop);
+    CHECK(true == HomedPosition::get(position));
+    CHECK(7 == position.idler);
+    CHECK(7 == position.selector);
+
+    eepromEraseAll();
+    writes = 0;
+}